@@ -40,6 +40,9 @@ void setup() {
     // Set the sensor descriptions, matrix column count is used for CSV output: a1,a2,a3,a4;b1,b2,b3,b4;c1 ...
     xmoduleSensor.setSensorInfo(infoName, infoDescription, pixelType, pixelUnit, columns);
 
+    // Full frames are sent to WebSocket, MQTT gets only the means of each row and column
+    xmoduleSensor.setMatrixOutput(CfgXmoduleSensor::OutputTarget::MQTT, MatrixView::Encoding::PROJECTION);
+
     // Add the sensor module to the mvp framework
     mvp.addXmodule(&xmoduleSensor);
 
@@ -62,63 +62,249 @@ void XmoduleSensor::setup() {
         return true;
     }, "Scaling reset.");
 
+    mvp.net.netWeb.registerAction("resetCalibration", [&](int args, WebArgKeyValue argKey, WebArgKeyValue argValue) {
+        resetCalibration();
+        return true;
+    }, "Calibration reset.");
+
     // Register CSV: latest, raw, scaled
     mvp.net.netWeb.registerFillerPage(uri + "data", [&](AsyncWebServerRequest *request) {
-        request->sendChunked("text/html", std::bind(&XmoduleSensor::csvLatestResponseFiller, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+        sendDataResponse(request, "text/html", true, DownloadFormat::CSV_SCALED);
     });
 
     mvp.net.netWeb.registerFillerPage(uri + "datasraw", [&](AsyncWebServerRequest *request) {
-        request->sendChunked("application/octet-stream", std::bind(&XmoduleSensor::csvRawResponseFiller, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+        sendDataResponse(request, "application/octet-stream", false, DownloadFormat::CSV_RAW);
     });
 
     mvp.net.netWeb.registerFillerPage(uri + "datasscaled", [&](AsyncWebServerRequest *request) {
-        request->sendChunked("application/octet-stream", std::bind(&XmoduleSensor::csvScaledResponseFiller, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+        sendDataResponse(request, "application/octet-stream", false, DownloadFormat::CSV_SCALED);
+    });
+
+    // Register CSV of a downsampled tier, scaled or raw
+    mvp.net.netWeb.registerFillerPage(uri + "datastier", [&](AsyncWebServerRequest *request) {
+        uint8_t tier = (request->hasParam("tier")) ? request->getParam("tier")->value().toInt() : 0;
+        if (tier >= dataCollection.dataTierCount) {
+            request->send(404, "text/plain", "Tier not found.");
+            return;
+        }
+        sendDataResponse(request, "application/octet-stream", false, (request->hasParam("raw")) ? DownloadFormat::CSV_RAW : DownloadFormat::CSV_SCALED, dataCollection.dataTiers[tier]);
+    });
+
+    // Register statistics as JSON
+    mvp.net.netWeb.registerFillerPage(uri + "stats", [&](AsyncWebServerRequest *request) {
+        request->send(200, "application/json", dataCollection.getStatisticsJson());
+    });
+
+    mvp.net.netWeb.registerAction("resetStatistics", [&](int args, WebArgKeyValue argKey, WebArgKeyValue argValue) {
+        resetStatistics();
+        return true;
+    }, "Statistics reset.");
+
+    // Register binary: raw with header including calibration
+    mvp.net.netWeb.registerFillerPage(uri + "datasbin", [&](AsyncWebServerRequest *request) {
+        sendDataResponse(request, "application/octet-stream", false, DownloadFormat::BINARY);
     });
 
     // Register websocket and MQTT
     mvp.net.netWeb.webSockets.registerWebSocket(uriWebSocket, std::bind(&XmoduleSensor::networkCtrlCallback, this, std::placeholders::_1));
     mvp.net.netMqtt.registerMqtt(mqttTopic, std::bind(&XmoduleSensor::networkCtrlCallback, this, std::placeholders::_1));
+
+    // Register event capture output
+    if (dataCollection.eventCapture != nullptr) {
+        mvp.net.netWeb.registerFillerPage(uri + "event", [&](AsyncWebServerRequest *request) {
+            sendEventResponse(request);
+        });
+        mvp.net.netWeb.webSockets.registerWebSocket(uriWebSocketEvent);
+        mvp.net.netMqtt.registerMqtt(mqttTopicEvent);
+    }
+
+    // Register spectrum output, latest results of all spectra as JSON array
+    if (dataCollection.spectrumCount > 0) {
+        mvp.net.netWeb.registerFillerPage(uri + "spectrum", [&](AsyncWebServerRequest *request) {
+            // The loop computes the results in place under the lock
+            uint64_t epochOffset_ms = _helper.millisStampToEpoch_ms(0);
+            String json = "[";
+            {
+                DataCollection::StoreLock lock(dataCollection);
+                for (uint8_t s = 0; s < dataCollection.spectrumCount; s++) {
+                    json += ((s > 0) ? "," : "") + dataCollection.getSpectrumJson(s, epochOffset_ms);
+                }
+            }
+            json += "]";
+            request->send(200, "application/json", json);
+        });
+        mvp.net.netWeb.webSockets.registerWebSocket(uriWebSocketSpectrum);
+        mvp.net.netMqtt.registerMqtt(mqttTopicSpectrum);
+    }
 }
 
 void XmoduleSensor::loop() {
+    // Drain samples queued from an interrupt or the other core, the batch is limited to what is queued now
+    // The size is read before the clock, so all samples of the batch were queued before now
+    if (dataCollection.sampleQueue != nullptr) {
+        uint32_t count = dataCollection.sampleQueue->getSize();
+        uint64_t nowMicros = DataCollection::getMicros64();
+        for (uint32_t i = 0; (i < count) && dataCollection.drainSample(nowMicros); i++) {
+            // Each finished averaging cycle is handled on its own
+            handleAverage();
+        }
+    }
+
+    handleAverage();
+    handleEvent();
+    handleSpectrum();
+}
+
+void XmoduleSensor::handleEvent() {
+    if ((dataCollection.eventCapture == nullptr) || !dataCollection.eventCapture->isReady())
+        return;
+
+    // Keep for download and capture the next event, encode once for all targets and send after the lock is released
+    // The web server of the ESP32 reads the kept event from its own task
+    boolean sendWebSocket = cfgXmoduleSensor.outputTargets.isSet(CfgXmoduleSensor::OutputTarget::WEBSOCKET);
+    boolean sendMqtt = cfgXmoduleSensor.outputTargets.isSet(CfgXmoduleSensor::OutputTarget::MQTT);
+    String frame;
+    boolean encoded = true;
+    {
+        DataCollection::StoreLock lock(dataCollection);
+        dataCollection.eventCapture->keep();
+        eventEpochOffset_ms = _helper.millisStampToEpoch_ms(0);
+        if (sendWebSocket || sendMqtt) {
+            encoded = dataCollection.encodeEvent(frame, cfgXmoduleSensor.matrixColumnCount, eventEpochOffset_ms);
+        }
+    }
+    mvp.logger.writeFormatted(CfgLogger::Level::INFO, "Event %d captured.", (int)dataCollection.eventCapture->keptNumber);
+
+    if (!encoded) {
+        mvp.logger.write(CfgLogger::Level::WARNING, "Event too large to send, download only.");
+        return;
+    }
+    if (sendWebSocket) {
+        mvp.net.netWeb.webSockets.printWebSocket(uriWebSocketEvent, frame);
+    }
+    if (sendMqtt) {
+        mvp.net.netMqtt.printMqtt(mqttTopicEvent, frame);
+    }
+}
+
+void XmoduleSensor::handleSpectrum() {
+    for (uint8_t s = 0; s < dataCollection.spectrumCount; s++) {
+        if (!dataCollection.spectra[s]->isReady())
+            continue;
+
+        // Samples are ignored until the block is computed, the next block starts with the interval
+        // The web server of the ESP32 reads the results from its own task, sending happens after the lock is released
+        String json;
+        {
+            DataCollection::StoreLock lock(dataCollection);
+            dataCollection.spectra[s]->compute();
+            json = dataCollection.getSpectrumJson(s, _helper.millisStampToEpoch_ms(0));
+        }
+
+        if (cfgXmoduleSensor.outputTargets.isSet(CfgXmoduleSensor::OutputTarget::WEBSOCKET)) {
+            mvp.net.netWeb.webSockets.printWebSocket(uriWebSocketSpectrum, json);
+        }
+        if (cfgXmoduleSensor.outputTargets.isSet(CfgXmoduleSensor::OutputTarget::MQTT)) {
+            mvp.net.netMqtt.printMqtt(mqttTopicSpectrum, json);
+        }
+    }
+}
+
+void XmoduleSensor::handleAverage() {
     // Check flag if there is something to do
     if (!dataCollection.avgCycleFinished)
         return;
     dataCollection.avgCycleFinished = false;;
 
+    // Encoded under the store lock, sent after it is released: a slow MQTT or WebSocket write does not stall downloads
+    String lines[outputTargetCount];
+    if (!encodeAverage(lines))
+        return;
+    for (uint8_t target = 0; target < outputTargetCount; target++) {
+        if (lines[target].length() > 0)
+            outputLine(target, lines[target]);
+    }
+}
+
+boolean XmoduleSensor::encodeAverage(String* lines) {
+    // Downloads wait until the newest measurement is kept or removed and encoded
+    DataCollection::StoreLock lock(dataCollection);
+
     // Check if offset or scaling measurement is running
     if (offsetRunning || scalingRunning) {
         measureOffsetScalingFinish();
-        return;
+        return false;
     }
 
+    // Consolidate all measurements into the downsampled tiers and statistics, independent of threshold and reporting interval
+    dataCollection.consolidateNewest();
+
     // Check if recording threshold was reached, otherwise just remove the measurement and do nothing
     // Threshold is not checked when appending but here: no need to check for offset/scaling measurements and averaging is already done/noise is lower
-    if (cfgXmoduleSensor.thresholdPermilleChange > 0) {
-        if (!dataCollection.linkedListSensor.isAboveThreshold(cfgXmoduleSensor.thresholdPermilleChange, cfgXmoduleSensor.thresholdOnlySingleIndex, &dataCollection.processing)) {
-            return;
+    // The deadband is kept around the last reported values, a slow drift is reported once it adds up to the threshold
+    DataDeadband::Band defaultBand = { cfgXmoduleSensor.thresholdAbsoluteChange, cfgXmoduleSensor.thresholdPermilleChange, false };
+    boolean deadbandActive = dataCollection.deadband->isActive(defaultBand);
+    if (deadbandActive) {
+        if (!dataCollection.isOutsideDeadband(defaultBand, cfgXmoduleSensor.thresholdOnlySingleIndex, (uint32_t)cfgXmoduleSensor.reportingHeartbeat * 1000)) {
+            return false;
         }
     }
 
     // Act only if timer a) was never started or b) just finished, otherwise remove measurment
     // This is not done when appending but here to not delay offset/scaling measurements, actual time is not known during averaging
-    if (!reportingTimer.justFinished()) {
-        dataCollection.linkedListSensor.removeLast();
-        return;
+    // Without interval all measurements are reported, also several drained from the sample queue at once
+    if ((cfgXmoduleSensor.reportingInterval > 0) && !reportingTimer.justFinished()) {
+        dataCollection.removeNewest();
+        return false;
+    }
+    if (deadbandActive) {
+        dataCollection.setDeadbandReference();
     }
 
     // Output data to serial, websocket, MQTT
-    if (cfgXmoduleSensor.outputTargets.isSet(CfgXmoduleSensor::OutputTarget::CONSOLE)) {
-        mvp.logger.write(CfgLogger::Level::DATA, dataCollection.linkedListSensor.getLatestAsCsvNoTime(cfgXmoduleSensor.matrixColumnCount, &dataCollection.processing).c_str() );
-    }
-    if (cfgXmoduleSensor.outputTargets.isSet(CfgXmoduleSensor::OutputTarget::WEBSOCKET)) {
-        mvp.net.netWeb.webSockets.printWebSocket(uriWebSocket, dataCollection.linkedListSensor.getLatestAsCsv(cfgXmoduleSensor.matrixColumnCount, &dataCollection.processing));
+    // Encode once, targets without matrix view share the line, serial omits the time stamp
+    if (cfgXmoduleSensor.outputTargets.isNone())
+        return false;
+    uint16_t newest = dataCollection.dataStore->getSize() - 1;
+    const char* csvLine = nullptr;
+    for (uint8_t target = 0; target < outputTargetCount; target++) {
+        if (!cfgXmoduleSensor.outputTargets.isSet(target))
+            continue;
+        if (matrixViews[target] != nullptr) {
+            // Nothing to send if no pixel changed
+            if (matrixViews[target]->encode(dataCollection.getProcessedValues(newest), _helper.millisStampToEpoch_ms(0) + dataCollection.dataStore->getMicrosStamp(newest) / 1000))
+                lines[target] = matrixViews[target]->line + ((target == CfgXmoduleSensor::OutputTarget::CONSOLE) ? matrixViews[target]->lineTimeLength : 0);
+            continue;
+        }
+        if (csvLine == nullptr)
+            csvLine = dataCollection.encodeCsvLine(newest, cfgXmoduleSensor.matrixColumnCount, true);
+        lines[target] = csvLine + ((target == CfgXmoduleSensor::OutputTarget::CONSOLE) ? dataCollection.csvLineTimeLength : 0);
     }
-    if (cfgXmoduleSensor.outputTargets.isSet(CfgXmoduleSensor::OutputTarget::MQTT)) {
-        mvp.net.netMqtt.printMqtt(mqttTopic, dataCollection.linkedListSensor.getLatestAsCsv(cfgXmoduleSensor.matrixColumnCount, &dataCollection.processing));
+    return true;
+}
+
+void XmoduleSensor::outputLine(uint8_t target, const String& line) {
+    switch (target) {
+        case CfgXmoduleSensor::OutputTarget::CONSOLE:
+            mvp.logger.write(CfgLogger::Level::DATA, line);
+            break;
+        case CfgXmoduleSensor::OutputTarget::WEBSOCKET:
+            mvp.net.netWeb.webSockets.printWebSocket(uriWebSocket, line);
+            break;
+        case CfgXmoduleSensor::OutputTarget::MQTT:
+            mvp.net.netMqtt.printMqtt(mqttTopic, line);
+            break;
     }
 }
 
+boolean XmoduleSensor::setMatrixView(uint8_t target, const MatrixView::Settings& settings) {
+    if ((target >= outputTargetCount) || !MatrixView::isValid(cfgXmoduleSensor.dataValueCount, cfgXmoduleSensor.matrixColumnCount, settings))
+        return false;
+    delete matrixViews[target];
+    matrixViews[target] = new MatrixView(cfgXmoduleSensor.dataValueCount, cfgXmoduleSensor.matrixColumnCount, settings);
+    return true;
+}
+
 
 //////////////////////////////////////////////////////////////////////////////////
 
@@ -162,9 +348,9 @@ bool XmoduleSensor::measureScaling(uint8_t valueNumber, int32_t targetValue) {
 void XmoduleSensor::measureOffsetScalingFinish() {
     // Calculate offset or scaling
     if (offsetRunning) {
-        dataCollection.processing.setOffset(dataCollection.linkedListSensor.getNewestData()->values);
+        dataCollection.processing.setOffset(dataCollection.dataStore->getNewestValues());
     } else if (scalingRunning) {
-        dataCollection.processing.setScaling(dataCollection.linkedListSensor.getNewestData()->values);
+        dataCollection.processing.setScaling(dataCollection.dataStore->getNewestValues());
     } else {
         mvp.logger.write(CfgLogger::Level::ERROR, "Offset/Scaling measurement finished without running.");
         return;
@@ -174,7 +360,7 @@ void XmoduleSensor::measureOffsetScalingFinish() {
 
     // Save
     mvp.config.writeCfg(dataCollection.processing);
-    mvp.logger.writeFormatted(CfgLogger::Level::INFO, "Offset/Scaling measurement done in %d ms.", millis() - dataCollection.avgStartTime );
+    mvp.logger.writeFormatted(CfgLogger::Level::INFO, "Offset/Scaling measurement done in %d ms.", (int)((DataCollection::getMicros64() - dataCollection.avgStartTime) / 1000) );
 
     // Restart data collection with new averaging
     clearTare();
@@ -185,23 +371,79 @@ void XmoduleSensor::measureOffsetScalingFinish() {
 }
 
 void XmoduleSensor::resetOffset() {
-    dataCollection.processing.offset.resetValues();
+    dataCollection.processing.resetOffset();
     mvp.config.writeCfg(dataCollection.processing);
     clearTare();
 }
 
 void XmoduleSensor::resetScaling() {
-    dataCollection.processing.scaling.resetValues();
+    dataCollection.processing.resetScaling();
+    mvp.config.writeCfg(dataCollection.processing);
+    clearTare();
+}
+
+bool XmoduleSensor::setCalibration(uint8_t valueNumber, const String& points) {
+    // Numbering starts from 1 in the real world!
+    if ((valueNumber == 0) || (valueNumber > cfgXmoduleSensor.dataValueCount)) {
+        mvp.logger.write(CfgLogger::Level::WARNING, "Calibration valueNumber out of bounds.");
+        return false;
+    }
+
+    // Points as space-separated input:output pairs, for example '0:0 512:480 1023:1000'
+    int32_t x[CalibrationTable::pointCountMax];
+    int32_t y[CalibrationTable::pointCountMax];
+    uint8_t count = 0;
+    boolean valid = true;
+    int16_t start = 0;
+    while (valid && (start < (int16_t)points.length())) {
+        int16_t end = points.indexOf(' ', start);
+        if (end < 0) {
+            end = points.length();
+        }
+        // Repeated spaces give empty pairs, skip them
+        if (end > start) {
+            int16_t separator = points.indexOf(':', start);
+            valid = (count < CalibrationTable::pointCountMax) && (separator > start) && (separator < end - 1);
+            if (valid) {
+                x[count] = points.substring(start, separator).toInt();
+                y[count] = points.substring(separator + 1, end).toInt();
+                count++;
+            }
+        }
+        start = end + 1;
+    }
+    if (!valid || !setCalibrationPoints(valueNumber - 1, x, y, count)) {
+        mvp.logger.write(CfgLogger::Level::WARNING, "Calibration points invalid.");
+        return false;
+    }
+
+    // Save
+    mvp.config.writeCfg(dataCollection.processing);
+    clearTare();
+    mvp.logger.writeFormatted(CfgLogger::Level::INFO, "Calibration of index %d set with %d points.", valueNumber - 1, count);
+    return true;
+}
+
+void XmoduleSensor::resetCalibration() {
+    dataCollection.processing.clearCalibrations();
     mvp.config.writeCfg(dataCollection.processing);
     clearTare();
 }
 
+void XmoduleSensor::resetStatistics() {
+    // Also called from the web server, on the ESP32 in parallel to consolidateNewest()
+    DataCollection::StoreLock lock(dataCollection);
+    if (dataCollection.statistics != nullptr) {
+        dataCollection.statistics->clear();
+    }
+}
+
 void XmoduleSensor::clearTare() {
-    dataCollection.processing.tare.resetValues();
+    dataCollection.processing.clearTare();
 }
 
 void XmoduleSensor::setTare() {
-    dataCollection.processing.setTare(dataCollection.linkedListSensor.getNewestData()->values);
+    dataCollection.processing.setTare(dataCollection.dataStore->getNewestValues());
 }
 
 
@@ -210,9 +452,42 @@ void XmoduleSensor::setTare() {
 void XmoduleSensor::networkCtrlCallback(const String &data) {
     if (data == "CONNECT") {
         // Send initial data to websocket to populate client view for slow sensors/reporting or if reportingThreshold is set
-        if (cfgXmoduleSensor.outputTargets.isSet(CfgXmoduleSensor::OutputTarget::WEBSOCKET) && (dataCollection.linkedListSensor.getSize() > 0)) {
-            mvp.net.netWeb.webSockets.printWebSocket(uriWebSocket, dataCollection.linkedListSensor.getLatestAsCsv(cfgXmoduleSensor.matrixColumnCount, &dataCollection.processing));
+        // Encoded under the store lock, sent after it is released
+        String line;
+        {
+            DataCollection::StoreLock lock(dataCollection);
+            if (cfgXmoduleSensor.outputTargets.isSet(CfgXmoduleSensor::OutputTarget::WEBSOCKET) && (dataCollection.dataStore->getSize() > 0)) {
+                MatrixView* view = matrixViews[CfgXmoduleSensor::OutputTarget::WEBSOCKET];
+                if (view == nullptr) {
+                    line = dataCollection.getLatestAsCsv(cfgXmoduleSensor.matrixColumnCount, true);
+                } else {
+                    // A new client needs the full matrix to apply differences to, it is sent to all clients
+                    uint16_t newest = dataCollection.dataStore->getSize() - 1;
+                    view->requestKeyframe();
+                    view->encode(dataCollection.getProcessedValues(newest), _helper.millisStampToEpoch_ms(0) + dataCollection.dataStore->getMicrosStamp(newest) / 1000);
+                    line = view->line;
+                }
+            }
+        }
+        if (line.length() > 0) {
+            mvp.net.netWeb.webSockets.printWebSocket(uriWebSocket, line);
         }
+    } else if (data == "STATS") {
+        // Statistics are sent to all enabled targets
+        String json = dataCollection.getStatisticsJson();
+        if (cfgXmoduleSensor.outputTargets.isSet(CfgXmoduleSensor::OutputTarget::WEBSOCKET)) {
+            mvp.net.netWeb.webSockets.printWebSocket(uriWebSocket, json);
+        }
+        if (cfgXmoduleSensor.outputTargets.isSet(CfgXmoduleSensor::OutputTarget::MQTT)) {
+            mvp.net.netMqtt.printMqtt(mqttTopic, json);
+        }
+    } else if (data.startsWith("CALIBRATE ")) {
+        // CALIBRATE <valueNumber> <input>:<output> ...
+        int16_t separator = data.indexOf(' ', 10);
+        if (separator < 0) {
+            separator = data.length();
+        }
+        setCalibration(data.substring(10, separator).toInt(), data.substring(separator + 1));
     } else if (data == "TARE") {
         setTare();
         mvp.logger.write(CfgLogger::Level::CONTROL, "Set Tare.");
@@ -239,6 +514,62 @@ String XmoduleSensor::webPageProcessor(uint8_t var) {
         case 103:
             return cfgXmoduleSensor.infoDescription;
 
+        case 108:
+            if (dataCollection.eventCapture == nullptr)
+                return "disabled";
+            return _helper.printFormatted("<a href='/sensorevent'>/sensorevent</a>, websocket /wssensorevent, %d events", (int)dataCollection.eventCapture->eventCount);
+        case 104:
+            if (dataCollection.spectrumCount == 0)
+                return "none";
+            {
+                String str = "<a href='/sensorspectrum'>/sensorspectrum</a>, websocket /wssensorspectrum";
+                for (uint8_t s = 0; s < dataCollection.spectrumCount; s++) {
+                    DataSpectrum* spectrum = dataCollection.spectra[s];
+                    str += "<br>#" + String(spectrum->valueIndex + 1) + ": " + String(spectrum->blockSize) + " samples, " + String(spectrum->bandCount) + " bands, "
+                        + String(spectrum->count) + " blocks";
+                }
+                return str;
+            }
+        case 122: {
+            const char* targets[] = { "console", "websocket", "MQTT" };
+            uint8_t columns = min(cfgXmoduleSensor.matrixColumnCount, cfgXmoduleSensor.dataValueCount);
+            String str = String(cfgXmoduleSensor.dataValueCount / columns) + "x" + String(columns);
+            for (uint8_t target = 0; target < outputTargetCount; target++) {
+                str += "<br>" + String(targets[target]) + ": " + ((matrixViews[target] != nullptr) ? matrixViews[target]->getDescription() : "all values");
+            }
+            return str;
+        }
+        case 105: {
+            if (cfgXmoduleSensor.virtualValueCount == 0)
+                return "none";
+            // One form per channel, numbered like the values
+            String forms = "";
+            for (uint8_t k = 0; k < cfgXmoduleSensor.virtualValueCount; k++) {
+                forms += "<form action='/save' method='post'> #" + String(dataCollection.sampleValueCount + k + 1) + " = <input name='virtualChannel" + String(k + 1)
+                    + "' value='" + cfgXmoduleSensor.virtualExpressions[k] + "' size='40'> <input type='submit' value='Save'> </form>";
+            }
+            return forms;
+        }
+        case 106:
+            return String(cfgXmoduleSensor.thresholdAbsoluteChange);
+        case 107:
+            return String(cfgXmoduleSensor.reportingHeartbeat);
+
+        case 109:
+            if (dataCollection.sampleQueue == nullptr)
+                return "disabled";
+            return _helper.printFormatted("%d / %d queued, %d dropped", (int)dataCollection.sampleQueue->getSize(), (int)dataCollection.sampleQueue->capacity, (int)dataCollection.sampleQueue->overflowCount.load());
+        case 110:
+            if (dataCollection.dataFilterCount == 0)
+                return "none";
+            {
+                String str = "";
+                for (uint8_t i = 0; i < dataCollection.dataFilterCount; i++) {
+                    str += dataCollection.dataFilters[i]->getDescription() + ((i < dataCollection.dataFilterCount - 1) ? " &rarr; " : "");
+                }
+                return str;
+            }
+
         case 111:
             return String(cfgXmoduleSensor.avgCountSample);
         case 112:
@@ -246,7 +577,7 @@ String XmoduleSensor::webPageProcessor(uint8_t var) {
         case 113:
             return String(cfgXmoduleSensor.reportingInterval);
         case 114:
-            return _helper.printFormatted("%d / %d (%s)", dataCollection.linkedListSensor.getSize(), dataCollection.linkedListSensor.getMaxSize(), (dataCollection.linkedListSensor.isAdaptive() ? "adaptive" : "fixed"));
+            return _helper.printFormatted("%d / %d (%s)", dataCollection.dataStore->getSize(), dataCollection.dataStore->getMaxSize(), dataCollection.dataStore->getTypeName());
         case 115:
             return String(cfgXmoduleSensor.dataValueCount);
         case 116:
@@ -254,17 +585,35 @@ String XmoduleSensor::webPageProcessor(uint8_t var) {
         case 117:
             return String(cfgXmoduleSensor.thresholdOnlySingleIndex);
 
+        case 118:
+            if (dataCollection.dataTierCount == 0)
+                return "none";
+            {
+                String str = "";
+                for (uint8_t i = 0; i < dataCollection.dataTierCount; i++) {
+                    DataTier* tier = dataCollection.dataTiers[i];
+                    // Whole seconds in s, others in ms
+                    boolean seconds = (tier->interval_ms % 1000 == 0);
+                    str += _helper.printFormatted("<a href='/sensordatastier?tier=%d'>%d %s</a> %d / %d%s", i, (int)((seconds) ? tier->interval_ms / 1000 : tier->interval_ms), (seconds) ? "s" : "ms", tier->dataStore->getSize(), tier->dataStore->getMaxSize(), (i < dataCollection.dataTierCount - 1) ? ", " : "");
+                }
+                return str;
+            }
+        case 119:
+            if (dataCollection.statistics == nullptr)
+                return "disabled";
+            return _helper.printFormatted("<a href='/sensorstats'>/sensorstats</a>, %u measurements <form action='/start' method='post' onsubmit='return confirm(`Reset statistics?`);'> <input name='resetStatistics' type='hidden'> <input type='submit' value='Reset'> </form>", (unsigned int)dataCollection.statistics->count);
         case 120: // Split the long string into multiple rows
             webPageProcessorCount = 0;
         case 121:
             webPageProcessorCount++;
-            // Sensor details: type, unit, offset, scaling, float to int exponent - placeholder for next row
-            return _helper.printFormatted("<tr> <td>%d</td> <td>%s</td> <td>%s</td> <td>%d</td> <td>%.2f</td> <td>%d</td> </tr>%s",
+            // Sensor details: type, unit, offset, scaling, calibration, float to int exponent - placeholder for next row
+            return _helper.printFormatted("<tr> <td>%d</td> <td>%s</td> <td>%s</td> <td>%d</td> <td>%.2f</td> <td>%s</td> <td>%d</td> </tr>%s",
                 webPageProcessorCount,
                 cfgXmoduleSensor.sensorTypes[webPageProcessorCount - 1],
                 cfgXmoduleSensor.sensorUnits[webPageProcessorCount - 1],
                 dataCollection.processing.offset.values[webPageProcessorCount - 1],
                 dataCollection.processing.scaling.values[webPageProcessorCount - 1],
+                (dataCollection.processing.calibrations[webPageProcessorCount - 1] == nullptr) ? "linear" : dataCollection.processing.calibrations[webPageProcessorCount - 1]->getDescription().c_str(),
                 dataCollection.processing.sampleToIntExponent.values[webPageProcessorCount - 1],
                 (webPageProcessorCount < cfgXmoduleSensor.dataValueCount) ? "%121%" : "");
 
@@ -273,78 +622,195 @@ String XmoduleSensor::webPageProcessor(uint8_t var) {
     }
 }
 
-size_t XmoduleSensor::csvLatestResponseFiller(uint8_t *buffer, size_t maxLen, size_t index) {
-    return csvExtendedResponseFiller(buffer, maxLen, index, true, [&]() -> String {
-        return dataCollection.linkedListSensor.getLatestAsCsv(cfgXmoduleSensor.matrixColumnCount, &dataCollection.processing);
-    });
-}
+void XmoduleSensor::sendDataResponse(AsyncWebServerRequest* request, const char* contentType, boolean latestOnly, DownloadFormat format, DataTier* tier) {
+    // Range of the download is fixed when the request arrives, start with the oldest data or only the newest
+    DataCollection::StoreLock lock(dataCollection);
+    DataStore* dataStore = (tier == nullptr) ? dataCollection.dataStore : tier->dataStore;
+    uint64_t epochOffset_ms = _helper.millisStampToEpoch_ms(0);
+    uint32_t sequenceStart = ((latestOnly) && (dataStore->getSize() > 0)) ? dataStore->sequenceNext - 1 : dataStore->getSequence(0);
+    uint32_t sequenceEnd = dataStore->sequenceNext;
+    if (!latestOnly) {
+        selectDownloadRange(request, dataStore, epochOffset_ms, sequenceStart, sequenceEnd);
+    }
 
-size_t XmoduleSensor::csvRawResponseFiller(uint8_t *buffer, size_t maxLen, size_t index) {
-    return csvExtendedResponseFiller(buffer, maxLen, index, false, [&]() -> String {
-        return dataCollection.linkedListSensor.getBookmarkAsCsv(cfgXmoduleSensor.matrixColumnCount, nullptr);
-    });
-}
+    size_t lineMaxLength = dataCollection.getCsvLineMaxLength(dataStore->valueCount);
+    if (format == DownloadFormat::BINARY) {
+        lineMaxLength = max((size_t)dataCollection.getBinaryRecordLength(), getBinaryHeaderLength());
+    }
+    std::shared_ptr<DataDownload> download = std::make_shared<DataDownload>(lineMaxLength, sequenceStart, sequenceEnd, format, epochOffset_ms);
+    download->tier = tier;
 
-size_t XmoduleSensor::csvScaledResponseFiller(uint8_t *buffer, size_t maxLen, size_t index) {
-    return csvExtendedResponseFiller(buffer, maxLen, index, false, [&]() -> String {
-        return dataCollection.linkedListSensor.getBookmarkAsCsv(cfgXmoduleSensor.matrixColumnCount, &dataCollection.processing);
+    // The header is sent as first line
+    if (format == DownloadFormat::BINARY) {
+        download->lineLength = encodeBinaryHeader(download->line);
+    }
+
+    // The filler holds the cursor, it is released with the response
+    request->sendChunked(contentType, [this, download](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+        return dataResponseFiller(*download, buffer, maxLen);
     });
 }
 
-size_t XmoduleSensor::csvExtendedResponseFiller(uint8_t* buffer, size_t maxLen, size_t index, boolean firstOnly, std::function<String()> stringFunc) {
-    // We assume the buffer is large enough for at least the first single row
-    // It would be quite the effort to reliably split a row into multiple calls
-
-    if (firstOnly && index > 0) {
-        // Single measurement should be sent out on first call
-        // There are cases of a few byte small buffers, but hopefully not during the first call, and even if we just dont care
-        return 0;
+void XmoduleSensor::selectDownloadRange(AsyncWebServerRequest* request, DataStore* dataStore, uint64_t epochOffset_ms, uint32_t& sequenceStart, uint32_t& sequenceEnd) {
+    // Query by epoch time stamp, sequence number, or count, combinations narrow the range
+    //  since=<epoch_ms>  samples after, for polling with the time of the last received sample
+    //  from=<epoch_ms>   samples at or after
+    //  to=<epoch_ms>     samples at or before
+    //  seq=<sequence>    samples with this or a higher sequence number, see binary download
+    //  last=<count>      the newest samples of the range
+    uint32_t sequenceOldest = dataStore->getSequence(0);
+
+    // Index of the first sample after the epoch time stamp in ms, as CSV shows it, samples before boot have negative millis
+    auto findIndexAfterEpoch = [&](int64_t epoch_ms) -> uint16_t {
+        int64_t millisStamp = epoch_ms - (int64_t)epochOffset_ms;
+        return (millisStamp < 0) ? 0 : dataStore->findIndexAfter(millisStamp * 1000 + 999);
+    };
+    // Sequence numbers wrap around, compare by difference
+    auto narrowStart = [&](uint32_t sequence) { if ((int32_t)(sequence - sequenceStart) > 0) sequenceStart = sequence; };
+
+    if (request->hasParam("since")) {
+        narrowStart(sequenceOldest + findIndexAfterEpoch(strtoll(request->getParam("since")->value().c_str(), nullptr, 10)));
     }
-    if (!firstOnly && (index == 0)) {
-        // The index relates only to string position, and does allow to select the next measurement
-        // Workaround is a bookmark in the linked list
-        dataCollection.linkedListSensor.bookmarkByIndex(0, false, true); // Start with the oldest data
+    if (request->hasParam("from")) {
+        narrowStart(sequenceOldest + findIndexAfterEpoch(strtoll(request->getParam("from")->value().c_str(), nullptr, 10) - 1));
     }
+    if (request->hasParam("to")) {
+        uint32_t sequence = sequenceOldest + findIndexAfterEpoch(strtoll(request->getParam("to")->value().c_str(), nullptr, 10));
+        if ((int32_t)(sequence - sequenceEnd) < 0) {
+            sequenceEnd = sequence;
+        }
+    }
+    if (request->hasParam("seq")) {
+        narrowStart(strtoul(request->getParam("seq")->value().c_str(), nullptr, 10));
+    }
+    if (request->hasParam("last")) {
+        narrowStart(sequenceEnd - strtoul(request->getParam("last")->value().c_str(), nullptr, 10));
+    }
+}
 
+size_t XmoduleSensor::dataResponseFiller(DataDownload& download, uint8_t* buffer, size_t maxLen) {
+    // The buffer is often just a few bytes long, lines are split over multiple calls if needed
+    // Called from the web server, on the ESP32 in parallel to the loop
+    DataCollection::StoreLock lock(dataCollection);
+
+    DataStore* dataStore = (download.tier == nullptr) ? dataCollection.dataStore : download.tier->dataStore;
     size_t pos = 0;
-    while (true) {
-        // Prepare CSV string
-        String str = stringFunc();
-        if (str.length() == 0) {
-            break; // Empty string, should not happen
-        }
-        str += "\n";
-        uint16_t strLen = str.length();
-
-        // Make sure there is enough space in the buffer
-        if (pos + strLen >= maxLen) {
-            if (pos == 0) {
-                // Well, this should not happen, buffer full even before the first iteration of the loop
-                // But it does! The buffer is often just a few (<10) bytes long
-                // This is actually so common, it is not even worth an info message
-                // mvp.logger.writeFormatted(CfgLogger::Level::INFO, "Web-CSV buffer too small for data: %d < %d.", maxLen, strLen);
-                // WORKAROUND: Return a single space to indicate there is more data. The next buffer will likely be larger.
-                if (maxLen > 0) {
-                    memcpy(buffer, " ", 1);
-                    pos++;
-                } // we do not catch maxLen = 0, but that should really really not happen!
+    while (pos < maxLen) {
+        // Line completely sent, encode the next measurement
+        if (download.linePos >= download.lineLength) {
+            if (download.format == DownloadFormat::EVENT) {
+                // Exit after the last line, or early if a newer event replaced the kept one meanwhile
+                if ((download.sequence >= download.sequenceEnd) || (dataCollection.eventCapture->keptNumber != download.eventNumber)) {
+                    break;
+                }
+                download.lineLength = dataCollection.encodeEventLine((char*)download.line, download.sequence, cfgXmoduleSensor.matrixColumnCount, download.epochOffset_ms);
+                download.line[download.lineLength++] = '\n';
+            } else {
+                // Samples evicted meanwhile are skipped, continue with the oldest available
+                uint32_t sequenceOldest = dataStore->getSequence(0);
+                if ((int32_t)(download.sequence - sequenceOldest) < 0) {
+                    download.sequence = sequenceOldest;
+                }
+                // Exit if this was the last measurement, the store could also have shrunk meanwhile
+                if (((int32_t)(download.sequence - download.sequenceEnd) >= 0) || ((int32_t)(download.sequence - dataStore->sequenceNext) >= 0)) {
+                    break;
+                }
+                uint16_t index = download.sequence - sequenceOldest;
+                if (download.format == DownloadFormat::BINARY) {
+                    download.lineLength = dataCollection.encodeBinary(download.line, index, download.epochOffset_ms);
+                } else if (download.tier != nullptr) {
+                    download.lineLength = dataCollection.encodeCsv((char*)download.line, download.tier, index, cfgXmoduleSensor.matrixColumnCount, download.format == DownloadFormat::CSV_SCALED, download.epochOffset_ms);
+                    download.line[download.lineLength++] = '\n';
+                } else {
+                    download.lineLength = dataCollection.encodeCsv((char*)download.line, index, cfgXmoduleSensor.matrixColumnCount, download.format == DownloadFormat::CSV_SCALED, download.epochOffset_ms);
+                    download.line[download.lineLength++] = '\n';
+                }
             }
-            break;
+            download.linePos = 0;
+            download.sequence++;
         }
 
-        // Copy string to the position in the buffer and increment position/total length
-        memcpy(buffer + pos, str.c_str(), strLen);
-        pos += strLen;
+        // Copy as much of the line as fits into the buffer
+        size_t len = min((size_t)(download.lineLength - download.linePos), maxLen - pos);
+        memcpy(buffer + pos, download.line + download.linePos, len);
+        download.linePos += len;
+        pos += len;
+    }
+
+    return pos;
+}
 
-        // Exit if this was the last measurement
-        if (!dataCollection.linkedListSensor.moveBookmark()) {
-            break;
+void XmoduleSensor::sendEventResponse(AsyncWebServerRequest* request) {
+    // Lines of the kept event are encoded as sent, the download ends early if the next event is kept meanwhile
+    DataCollection::StoreLock lock(dataCollection);
+    EventCapture* eventCapture = dataCollection.eventCapture;
+    if (eventCapture->keptNumber == 0) {
+        request->send(404, "text/plain", "No event captured.");
+        return;
+    }
+    std::shared_ptr<DataDownload> download = std::make_shared<DataDownload>(dataCollection.getEventLineMaxLength(), 0, eventCapture->keptSize + 1, DownloadFormat::EVENT, eventEpochOffset_ms);
+    download->eventNumber = eventCapture->keptNumber;
+
+    request->sendChunked("text/plain", [this, download](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+        return dataResponseFiller(*download, buffer, maxLen);
+    });
+}
+
+size_t XmoduleSensor::getBinaryHeaderLength() {
+    size_t length = 8;
+    for (uint8_t i = 0; i < cfgXmoduleSensor.dataValueCount; i++) {
+        length += 13 + 2 + min(strlen(cfgXmoduleSensor.sensorTypes[i]), (size_t)255) + min(strlen(cfgXmoduleSensor.sensorUnits[i]), (size_t)255);
+        CalibrationTable* calibration = dataCollection.processing.calibrations[i];
+        length += 1 + ((calibration != nullptr) ? 8 * calibration->pointCount : 0);
+    }
+    return length;
+}
+
+size_t XmoduleSensor::encodeBinaryHeader(uint8_t* buffer) {
+    // Little-endian, as ESP8266 and ESP32 natively are
+    //  char[4]  magic "MVPB"
+    //  uint8    format version, 3 with calibration tables, 2 with time stamps in microseconds
+    //  uint8    value count
+    //  uint8    matrix column count
+    //  uint8    reserved
+    // Per value:
+    //  int8     sample-to-int exponent
+    //  int32    offset
+    //  float32  scaling
+    //  int32    tare
+    //  uint8    length, char[] type
+    //  uint8    length, char[] unit
+    //  uint8    calibration point count, 0 for linear scaling
+    //  int32[]  calibration inputs, then int32[] outputs, see CalibrationTable
+    // Followed by the records, see DataCollection::encodeBinary()
+    DataProcessing& processing = dataCollection.processing;
+    size_t pos = 0;
+    memcpy(buffer, "MVPB", 4);
+    pos += 4;
+    buffer[pos++] = 3;
+    buffer[pos++] = cfgXmoduleSensor.dataValueCount;
+    buffer[pos++] = cfgXmoduleSensor.matrixColumnCount;
+    buffer[pos++] = 0;
+    for (uint8_t i = 0; i < cfgXmoduleSensor.dataValueCount; i++) {
+        buffer[pos++] = processing.sampleToIntExponent.values[i];
+        memcpy(buffer + pos, &processing.offset.values[i], 4);
+        memcpy(buffer + pos + 4, &processing.scaling.values[i], 4);
+        memcpy(buffer + pos + 8, &processing.tare.values[i], 4);
+        pos += 12;
+        for (const char* str : { cfgXmoduleSensor.sensorTypes[i], cfgXmoduleSensor.sensorUnits[i] }) {
+            uint8_t length = min(strlen(str), (size_t)255);
+            buffer[pos++] = length;
+            memcpy(buffer + pos, str, length);
+            pos += length;
         }
-        // Exit if the next measurement would (probably, with some margin) not fit
-        if (pos + 1.2 * strLen > maxLen) {
-            break;
+        // The interpolation points as used on the device, also for a polynomial
+        CalibrationTable* calibration = processing.calibrations[i];
+        buffer[pos++] = (calibration != nullptr) ? calibration->pointCount : 0;
+        if (calibration != nullptr) {
+            memcpy(buffer + pos, calibration->x, 4 * calibration->pointCount);
+            memcpy(buffer + pos + 4 * calibration->pointCount, calibration->y, 4 * calibration->pointCount);
+            pos += 8 * calibration->pointCount;
         }
     }
-
     return pos;
-}
\ No newline at end of file
+}
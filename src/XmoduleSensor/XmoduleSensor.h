@@ -18,8 +18,11 @@ limitations under the License.
 #define MVP3000_XMODULESENSOR
 
 #include <Arduino.h>
+#include <array>
+#include <memory>
 
 #include <ArduinoJson.h>
+#include <ESPAsyncWebServer.h>
 
 #include "_Xmodule.h"
 #include "_Helper_LimitTimer.h"
@@ -45,15 +48,19 @@ struct CfgXmoduleSensor : CfgJsonInterface {
     uint8_t avgCountSample = 10; // At least 1
     uint8_t avgCountOffsetScaling = 25; // At least 1
     uint16_t reportingInterval = 0; // [ms], 0 to ignore
-    uint8_t thresholdPermilleChange = 0; // 0 to disable
+    uint8_t thresholdPermilleChange = 0; // Relative to the last reported value, 0 to disable
+    uint16_t thresholdAbsoluteChange = 0; // Integer units, relative to the last reported value, 0 to disable
     int16_t thresholdOnlySingleIndex = -1; // Max 255, -1 to apply to all values
+    uint16_t reportingHeartbeat = 0; // [s], report at least this often despite the threshold, 0 to disable
 
     CfgXmoduleSensor() : CfgJsonInterface("cfgXmoduleSensor") {
         addSetting<uint8_t>("avgCountSample", &avgCountSample, [&](const String& s) { uint8_t n = s.toInt(); if (n == 0) return false; avgCountSample = n; return true; } );
         addSetting<uint8_t>("avgCountOffsetScaling", &avgCountOffsetScaling, [&](const String& s) { uint8_t n = s.toInt(); if (n == 0) return false; avgCountOffsetScaling = n; return true; } );
         addSetting<uint16_t>("reportingInterval", &reportingInterval, [&](const String& s) { reportingInterval = s.toInt(); return true; } );
         addSetting<uint8_t>("thresholdPermilleChange", &thresholdPermilleChange, [&](const String& s) { thresholdPermilleChange = s.toInt(); return true; } );
+        addSetting<uint16_t>("thresholdAbsoluteChange", &thresholdAbsoluteChange, [&](const String& s) { thresholdAbsoluteChange = s.toInt(); return true; } );
         addSetting<int16_t>("thresholdOnlySingleIndex", &thresholdOnlySingleIndex, [&](const String& s) { int16_t n = s.toInt(); if ((n < -1) || (n > 255)) return false; thresholdOnlySingleIndex = n; return true; } );
+        addSetting<uint16_t>("reportingHeartbeat", &reportingHeartbeat, [&](const String& s) { reportingHeartbeat = s.toInt(); return true; } );
     };
 
     // Settings that are not known during creation of this config within the framework but need init before anything works
@@ -70,6 +77,10 @@ struct CfgXmoduleSensor : CfgJsonInterface {
     // Used for output only, matrix data with a row length, if matrixColumnCount >= dataValueCount it is obviously a single row
     uint8_t matrixColumnCount = 255;
 
+    // Virtual channels are the last values, computed from an expression saved as setting
+    uint8_t virtualValueCount = 0;
+    String* virtualExpressions = nullptr;
+
     void initValueCount(uint8_t _dataValueCount) {
         dataValueCount = _dataValueCount;
 
@@ -79,10 +90,31 @@ struct CfgXmoduleSensor : CfgJsonInterface {
         sensorUnits = new const char*[dataValueCount];
     }
 
+    /**
+     * Add a setting for the expression of each virtual channel, checked by compiling it.
+     */
+    void initVirtualChannels(uint8_t _virtualValueCount, std::function<bool(uint8_t, const String&)> compile) {
+        virtualValueCount = _virtualValueCount;
+        virtualExpressions = new String[virtualValueCount];
+        for (uint8_t k = 0; k < virtualValueCount; k++) {
+            uint8_t i = dataValueCount - virtualValueCount + k;
+            sensorTypes[i] = "virtual";
+            sensorUnits[i] = "";
+            addSetting<String>("virtualChannel" + String(k + 1), &virtualExpressions[k], [this, k, i, compile](const String& s) {
+                if (!compile(k, s))
+                    return false;
+                virtualExpressions[k] = s;
+                // The expression is the type, an empty one is still virtual
+                sensorTypes[i] = (s.length() > 0) ? virtualExpressions[k].c_str() : "virtual";
+                return true;
+            } );
+        }
+    }
+
     void setSensorInfo(const String& _infoName, const String& _infoDescription, String* _sensorTypes, String* _sensorUnits) {
         infoName = _infoName.c_str();
         infoDescription = _infoDescription.c_str();
-        for (u_int8_t i = 0; i < dataValueCount; i++) {
+        for (u_int8_t i = 0; i < dataValueCount - virtualValueCount; i++) {
             sensorTypes[i] = _sensorTypes[i].c_str();
             sensorUnits[i] = _sensorUnits[i].c_str();
         }
@@ -91,7 +123,7 @@ struct CfgXmoduleSensor : CfgJsonInterface {
     void setSensorInfo(const String& _infoName, const String& _infoDescription, const String& _pixelType, const String& _pixelUnit, uint8_t _matrixColumnCount) {
         infoName = _infoName.c_str();
         infoDescription = _infoDescription.c_str();
-        for (u_int8_t i = 0; i < dataValueCount; i++) {
+        for (u_int8_t i = 0; i < dataValueCount - virtualValueCount; i++) {
             sensorTypes[i] = _pixelType.c_str();
             sensorUnits[i] = _pixelUnit.c_str();
         }
@@ -110,12 +142,24 @@ class XmoduleSensor : public _Xmodule {
          * @brief Construct a new Sensor Module object.
          *
          * @param valueCount The number of values simultaneously coming from the sensor(s).
+         * @param virtualCount (optional) The number of virtual channels following the values, computed from expressions
+         *  set in the web interface or with setVirtualChannel(). Default is 0.
          */
-        XmoduleSensor(uint8_t valueCount) : _Xmodule("Sensor Module", "/sensor") {
+        XmoduleSensor(uint8_t valueCount, uint8_t virtualCount = 0) : _Xmodule("Sensor Module", "/sensor") {
             uriWebSocket = "/wssensor";
             mqttTopic = "sensor";
-            cfgXmoduleSensor.initValueCount(valueCount);
-            dataCollection.initDataValueSize(valueCount); // Averaging can change during operation
+            uriWebSocketEvent = "/wssensorevent";
+            mqttTopicEvent = "sensorevent";
+            uriWebSocketSpectrum = "/wssensorspectrum";
+            mqttTopicSpectrum = "sensorspectrum";
+            cfgXmoduleSensor.initValueCount(valueCount + virtualCount);
+            dataCollection.initDataValueSize(valueCount + virtualCount); // Averaging can change during operation
+            if (virtualCount > 0) {
+                dataCollection.initVirtualChannels(virtualCount);
+                cfgXmoduleSensor.initVirtualChannels(virtualCount, [&](uint8_t index, const String& expression) {
+                    return dataCollection.setVirtualChannel(index, expression.c_str());
+                });
+            }
         };
 
 
@@ -131,6 +175,120 @@ class XmoduleSensor : public _Xmodule {
             dataCollection.addSample(newSample);
         };
 
+        /**
+         * @brief Add a block of samples at once, for sensors with a FIFO or block reads.
+         *
+         * Time stamps are derived from the interval, the last sample is taken as read now. Finished averaging cycles are
+         * handled right away, so a block can span several.
+         *
+         * @tparam T The numeric type of the sample, typically int or float.
+         * @param block The samples one after the other, count times the value count.
+         * @param count The number of samples in the block.
+         * @param interval_us The time between two samples in microseconds.
+         */
+        template <typename T>
+        void addSamples(const T *block, size_t count, uint32_t interval_us) {
+            uint8_t valueCount = dataCollection.sampleValueCount;
+            addBlock(count, interval_us, [&](size_t k, uint64_t sampleMicros) {
+                dataCollection.addSample(&block[k * valueCount], sampleMicros);
+            });
+        };
+
+
+        /**
+         * @brief Add a raw sample from an interrupt or a task on the other core, time stamped now.
+         *
+         * Requires enableSampleQueue(). The sample is queued without further processing and added in the next loop, so
+         * samples are not lost while the loop is busy with network or file operations.
+         *
+         * @param newSample The new sample array of integer values to add.
+         * @return False if the queue is full or not enabled, and the sample was dropped.
+         */
+        IRAM_ATTR boolean queueSample(const int32_t *newSample) {
+            if (dataCollection.sampleQueue == nullptr)
+                return false;
+            return dataCollection.sampleQueue->push(newSample, micros());
+        };
+
+        /**
+         * @brief Add a raw sample from an interrupt or a task on the other core.
+         *
+         * @param newSample The new sample array of integer values to add.
+         * @param stamp_us The time of the sample from micros(), at most about half an hour old when drained.
+         * @return False if the queue is full or not enabled, and the sample was dropped.
+         */
+        IRAM_ATTR boolean queueSample(const int32_t *newSample, uint32_t stamp_us) {
+            if (dataCollection.sampleQueue == nullptr)
+                return false;
+            return dataCollection.sampleQueue->push(newSample, stamp_us);
+        };
+
+        /**
+         * @brief Enable capture of events in the raw samples, like an oscilloscope.
+         *
+         * The latest samples before a trigger are kept in a ring. When a trigger fires, the following samples are added
+         * and the event is sent as one frame to WebSocket /wssensorevent and MQTT topic sensorevent. The latest event
+         * can be downloaded from /sensorevent. Samples are captured at full rate, before filtering and averaging.
+         *
+         * @param preCount The number of samples before the trigger sample.
+         * @param postCount The number of samples after the trigger sample.
+         * @return False if preCount + 1 + postCount exceeds 65535 or the capture ring and the ring of the kept event do not
+         *  fit into the free heap, leaving 16 kB. A previous capture stays enabled then.
+         */
+        boolean enableEventCapture(uint16_t preCount, uint16_t postCount) {
+            return dataCollection.enableEventCapture(preCount, postCount);
+        };
+
+        /**
+         * @brief Add a trigger for the event capture, an event starts when any trigger fires. Up to 4 triggers.
+         *
+         * @param valueIndex The index of the value to watch, starting with 0.
+         * @param mode RISING or FALLING crossing of the threshold, SLOPE for a change to the previous sample of at least
+         *  the threshold, or DEVIATION from the rolling mean of about 64 samples of at least the threshold.
+         * @param threshold The threshold in integer units of the raw samples, after the sample-to-int exponent.
+         * @return False if event capture is not enabled, the index is out of range, or there are 4 triggers.
+         */
+        boolean addEventTrigger(uint8_t valueIndex, EventCapture::TriggerMode mode, int32_t threshold) {
+            if (dataCollection.eventCapture == nullptr) {
+                return false;
+            }
+            return dataCollection.eventCapture->addTrigger(valueIndex, mode, threshold);
+        };
+
+        /**
+         * @brief Add a spectrum of a single value, for vibration and noise sensors. Up to 4, call before adding the module.
+         *
+         * Blocks of raw samples are collected at full rate, before filtering and averaging, and transformed on the device
+         * with a fixed-point FFT after removing the mean and applying a Hann window. The result is the RMS in equal-width
+         * bands up to half the sample rate and the frequency of the strongest component. It is sent as JSON to WebSocket
+         * /wssensorspectrum and MQTT topic sensorspectrum, the latest results can be downloaded from /sensorspectrum.
+         * The sample rate is taken from the time stamps of the block.
+         *
+         * @param valueIndex The index of the value, starting with 0. Virtual channels can be used.
+         * @param blockSize The number of samples per block, a power of two from 16 to 1024. It needs about 5 bytes per sample,
+         *  the frequency resolution is the sample rate divided by the block size.
+         * @param bandCount The number of bands, 1 to 16.
+         * @param interval_ms (optional) The time from the start of one block to the start of the next, 0 for blocks
+         *  right after each other. Default is 0.
+         * @return False if the index is out of range, block size or band count are invalid, or there are 4 spectra.
+         */
+        boolean addSpectrum(uint8_t valueIndex, uint16_t blockSize, uint8_t bandCount, uint32_t interval_ms = 0) {
+            return dataCollection.addSpectrum(valueIndex, blockSize, bandCount, interval_ms);
+        };
+
+        /**
+         * @brief Enable the queue for queueSample(), call before adding the module.
+         *
+         * A lock-free single-producer single-consumer ring: one interrupt or task adds samples, the loop drains all
+         * queued samples each time. Dropped samples of a full queue are counted and shown on the web page.
+         *
+         * @param length The number of samples to buffer, rounded up to a power of two. Cover the longest expected
+         *  stall of the loop, for example 2048 for 2 s at 1 kHz.
+         */
+        void enableSampleQueue(uint16_t length) {
+            dataCollection.enableSampleQueue(length);
+        };
+
 
         /**
          * @brief Disable data output serial. This does not affect general logging to serial.
@@ -148,6 +306,63 @@ class XmoduleSensor : public _Xmodule {
         void disableWebSocket() { cfgXmoduleSensor.outputTargets.change(CfgXmoduleSensor::OutputTarget::WEBSOCKET, false); };
 
 
+        /**
+         * @brief Send a reduced matrix to an output target instead of all values, call after setSensorInfo().
+         *
+         * The frame is cropped to the region set with setMatrixRegion(), binned, and encoded for this target only, so
+         * for example WebSocket streams full frames while MQTT gets a small summary. Downloads are not affected.
+         *
+         * @param target The output target: CfgXmoduleSensor::OutputTarget::CONSOLE, WEBSOCKET, or MQTT.
+         * @param encoding MATRIX for all binned pixels, PROJECTION for the mean of each row followed by the mean of each
+         *  column, or DIFFERENCE for only the binned pixels that changed since they were last sent, as index:value with
+         *  the index counted row by row from 0. DIFFERENCE sends a full matrix as key frame at start, regularly, and to
+         *  a new WebSocket client; nothing is sent if no pixel changed.
+         * @param binning (optional) Average blocks of binning x binning pixels, 1 to 8. Default is 1.
+         * @param changeThreshold (optional) DIFFERENCE sends pixels that changed by more, in integer units after
+         *  offset, scaling, and tare. Default is 0.
+         * @param keyframeInterval (optional) DIFFERENCE outputs between key frames, 0 for key frames only at start and
+         *  for new clients. Default is 100.
+         * @return False if the value count is not a whole number of rows or the settings are invalid.
+         */
+        boolean setMatrixOutput(CfgXmoduleSensor::OutputTarget target, MatrixView::Encoding encoding, uint8_t binning = 1, int32_t changeThreshold = 0, uint16_t keyframeInterval = 100) {
+            MatrixView::Settings settings = (matrixViews[target] != nullptr) ? matrixViews[target]->settings : MatrixView::Settings();
+            settings.encoding = encoding;
+            settings.binning = binning;
+            settings.changeThreshold = changeThreshold;
+            settings.keyframeInterval = keyframeInterval;
+            return setMatrixView(target, settings);
+        };
+
+        /**
+         * @brief Crop the matrix sent to an output target to a region, call after setSensorInfo().
+         *
+         * @param target The output target: CfgXmoduleSensor::OutputTarget::CONSOLE, WEBSOCKET, or MQTT.
+         * @param firstRow The first row of the region, starting with 0.
+         * @param firstColumn The first column of the region, starting with 0.
+         * @param rowCount The number of rows, 0 for all from the first row on.
+         * @param columnCount The number of columns, 0 for all from the first column on.
+         * @return False if the value count is not a whole number of rows or the region exceeds the matrix.
+         */
+        boolean setMatrixRegion(CfgXmoduleSensor::OutputTarget target, uint8_t firstRow, uint8_t firstColumn, uint8_t rowCount, uint8_t columnCount) {
+            MatrixView::Settings settings = (matrixViews[target] != nullptr) ? matrixViews[target]->settings : MatrixView::Settings();
+            settings.firstRow = firstRow;
+            settings.firstColumn = firstColumn;
+            settings.rowCount = rowCount;
+            settings.columnCount = columnCount;
+            return setMatrixView(target, settings);
+        };
+
+        /**
+         * @brief Send all values to an output target again, undoing setMatrixOutput() and setMatrixRegion().
+         *
+         * @param target The output target: CfgXmoduleSensor::OutputTarget::CONSOLE, WEBSOCKET, or MQTT.
+         */
+        void resetMatrixOutput(CfgXmoduleSensor::OutputTarget target) {
+            delete matrixViews[target];
+            matrixViews[target] = nullptr;
+        };
+
+
         /**
          * @brief Set data collection to adaptive mode, growing depending on available memory.
          * 
@@ -156,7 +371,130 @@ class XmoduleSensor : public _Xmodule {
          * the program and thus lead to stability issues, particularly with fragmented memory.
          */
         void setDataCollectionAdaptive() {
-            dataCollection.linkedListSensor.enableAdaptiveGrowing();
+            dataCollection.dataStore->enableAdaptiveGrowing();
+        };
+
+        /**
+         * @brief Store data in a ring buffer of fixed length instead of the default linked list.
+         *
+         * Time stamps and values are kept in one contiguous preallocated block each, without the per-measurement
+         * allocations and pointers of the linked list. Significantly more measurements fit in the same memory,
+         * but the ring buffer cannot grow adaptively.
+         *
+         * The columnar layout keeps the values of each sensor contiguous. This speeds up single-value evaluation like the
+         * threshold check of a single index, particularly for sensors with many values like a matrix.
+         *
+         * @param length The number of measurements to store, at least one.
+         * @param columnar (optional) Store values sensor by sensor instead of measurement by measurement. Default is false.
+         * @return False if the length is zero, the current store is kept.
+         */
+        boolean setDataCollectionRingBuffer(uint16_t length, boolean columnar = false) {
+            return dataCollection.useRingBuffer(length, columnar);
+        };
+
+        /**
+         * @brief Add a downsampled history tier storing mean, minimum, and maximum of each value per interval.
+         *
+         * Measurements are consolidated incrementally, for example 1 s for 5 min, 1 min for 24 h, and 15 min for 7 days.
+         * Long-term trends fit in a few kB. Up to 4 tiers for sensors with up to 85 values. Tiers are downloaded as CSV from
+         * /sensordatastier?tier=N, add &raw for values without offset, scaling, and tare.
+         *
+         * @param interval_ms The interval length in milliseconds.
+         * @param length The number of intervals to store.
+         * @return False if the tier could not be added.
+         */
+        boolean addDataTier(uint32_t interval_ms, uint16_t length) {
+            return dataCollection.addDataTier(interval_ms, length);
+        };
+
+        /**
+         * @brief Add a downsampled history tier, stored compressed in a ring of fixed-size blocks.
+         *
+         * @param interval_ms The interval length in milliseconds.
+         * @param blockCount The number of blocks, at least 2.
+         * @param blockSize (optional) The size of a block in bytes, at least 10 + 15 per value. Default is 256.
+         * @return False if the tier could not be added.
+         */
+        boolean addDataTierCompressed(uint32_t interval_ms, uint16_t blockCount, uint16_t blockSize = 256) {
+            return dataCollection.addDataTierCompressed(interval_ms, blockCount, blockSize);
+        };
+
+        /**
+         * @brief Append an exponential moving average with smoothing factor 1/2^shift to the filter chain.
+         *
+         * The filter chain is applied per value to every sample before averaging, in the order the stages were added.
+         * All stages use integer arithmetic and preallocated state. Up to 6 stages.
+         *
+         * @param shift The smoothing factor as power of two, 1 to 15. For example 4 for 1/16.
+         * @return False if the maximum number of stages is reached.
+         */
+        boolean addFilterEma(uint8_t shift) {
+            return dataCollection.addFilter(new DataFilterEma(cfgXmoduleSensor.dataValueCount, shift));
+        };
+
+        /**
+         * @brief Append a moving median to the filter chain, to reject single spikes.
+         *
+         * @param window The number of samples, odd numbers avoid averaging the middle two. O(window) per sample.
+         * @return False if the maximum number of stages is reached.
+         */
+        boolean addFilterMedian(uint8_t window) {
+            return dataCollection.addFilter(new DataFilterMedian(cfgXmoduleSensor.dataValueCount, window));
+        };
+
+        /**
+         * @brief Append a CIC decimator to the filter chain, keeping every factor-th sample.
+         *
+         * The decimator is a moving average of length factor applied order times, without multiplications. Unlike the
+         * sample averaging it is not limited to 255 samples, a 1 kHz stream can be reduced to 1 Hz on the device.
+         *
+         * @param factor The decimation factor.
+         * @param order (optional) The number of stages, 1 to 4, higher orders suppress aliasing better. Default is 1.
+         * @return False if the maximum number of stages is reached or factor^order exceeds 2^31.
+         */
+        boolean addFilterDecimation(uint16_t factor, uint8_t order = 1) {
+            if (!DataFilterCic::isValid(factor, order)) {
+                return false;
+            }
+            return dataCollection.addFilter(new DataFilterCic(cfgXmoduleSensor.dataValueCount, factor, order));
+        };
+
+        /**
+         * @brief Append a one-dimensional Kalman filter to the filter chain, for a slowly drifting value.
+         *
+         * @param processNoise The variance of the change between two samples, in squared units of the integer values.
+         * @param measurementNoise The variance of the measurement noise, in squared units of the integer values.
+         * @return False if the maximum number of stages is reached.
+         */
+        boolean addFilterKalman(uint32_t processNoise, uint32_t measurementNoise) {
+            return dataCollection.addFilter(new DataFilterKalman(cfgXmoduleSensor.dataValueCount, processNoise, measurementNoise));
+        };
+
+        /**
+         * @brief Enable streaming statistics of each value: mean, standard deviation, minimum and maximum overall and over
+         * a window of recent measurements, and the 5 %, 50 %, and 95 % quantiles.
+         *
+         * Statistics are updated with every measurement in constant time and memory, independent of the data storage.
+         * They are available as JSON at /sensorstats and sent to WebSocket and MQTT on the control command STATS.
+         *
+         * @param window (optional) The number of recent measurements for windowed minimum and maximum. Default is 32.
+         */
+        void enableStatistics(uint16_t window = 32) {
+            dataCollection.enableStatistics(window);
+        };
+
+        /**
+         * @brief Store data compressed, as differences to the previous measurement, in a ring of fixed-size blocks.
+         *
+         * Slowly changing signals like temperature or CO2 need about one byte per value instead of four, several times
+         * more measurements fit in the same memory. Data is decoded when read, the oldest block is discarded as a whole.
+         *
+         * @param blockCount The number of blocks, at least 2.
+         * @param blockSize (optional) The size of a block in bytes, at least 10 + 5 per value. Default is 256.
+         * @return False if blockCount or blockSize is too small, the store is kept then.
+         */
+        boolean setDataCollectionCompressed(uint16_t blockCount, uint16_t blockSize = 256) {
+            return dataCollection.useCompressed(blockSize, blockCount);
         };
 
         /**
@@ -167,7 +505,7 @@ class XmoduleSensor : public _Xmodule {
         void setReportingInterval(uint16_t reportingInterval) { cfgXmoduleSensor.reportingInterval = reportingInterval; };
 
         /**
-         * @brief Set the reporting threshold in permille change.
+         * @brief Set the reporting threshold in permille change to the last reported value.
          * 
          * @param thresholdPermilleChange The threshold in permille change.
          * @param thresholdOnlySingleIndex (optional) The index of the value to apply the threshold to, -1 for all values (default).
@@ -177,6 +515,32 @@ class XmoduleSensor : public _Xmodule {
             cfgXmoduleSensor.updateSingleValue("thresholdOnlySingleIndex", String(thresholdOnlySingleIndex)); // Use set function as datatype is different to allow -1
         };
 
+        /**
+         * @brief Set the reporting threshold in absolute change to the last reported value.
+         * 
+         * @param thresholdAbsoluteChange The threshold in integer units, after offset, scaling, and the sample-to-int exponent.
+         */
+        void setReportingThresholdAbsolute(uint16_t thresholdAbsoluteChange) { cfgXmoduleSensor.thresholdAbsoluteChange = thresholdAbsoluteChange; };
+
+        /**
+         * @brief Set the deadband of a single value, replacing the reporting thresholds for this value.
+         * 
+         * @param valueIndex The index of the value.
+         * @param absoluteChange The absolute band in integer units, 0 to disable.
+         * @param permilleChange The relative band in permille, 0 to disable.
+         * @return False if the index is out of range.
+         */
+        boolean setReportingDeadband(uint8_t valueIndex, uint32_t absoluteChange, uint16_t permilleChange) {
+            return dataCollection.deadband->setBand(valueIndex, absoluteChange, permilleChange);
+        };
+
+        /**
+         * @brief Set the maximum time between data reports, measurements are reported at least this often despite the thresholds.
+         * 
+         * @param reportingHeartbeat The interval in seconds, 0 to disable.
+         */
+        void setReportingHeartbeat(uint16_t reportingHeartbeat) { cfgXmoduleSensor.reportingHeartbeat = reportingHeartbeat; };
+
         /**
          * @brief Set initial sample averaging count after first compile. This value is superseeded by the user-set/saved value in the web interface.
          * 
@@ -184,13 +548,75 @@ class XmoduleSensor : public _Xmodule {
          */
         void setSampleAveraging(uint8_t avgCountSample) { cfgXmoduleSensor.avgCountSample = avgCountSample; };
 
+        /**
+         * @brief Use integer fixed-point arithmetic to apply offset, scaling and tare instead of float.
+         *
+         * The ESP8266 has no FPU, every float operation is emulated in software. The fixed-point result is within one
+         * LSB of the float result.
+         *
+         * @param enable (optional) True to enable, false to disable. Default is true.
+         */
+        void setFixedPointProcessing(boolean enable = true) { dataCollection.processing.setFixedPoint(enable); };
+
+        /**
+         * @brief Set a non-linear calibration of a value from measured points, replacing its scaling. Values in between
+         * are interpolated linearly, values outside are clamped to the first and last point. A calibration saved on the
+         * device supersedes this one.
+         *
+         * @param valueIndex The index of the value.
+         * @param x The inputs, the sample with offset applied, strictly increasing.
+         * @param y The calibrated outputs in integer units.
+         * @param count The number of points, 2 to 32.
+         * @return False if the index is out of range or the points are invalid.
+         */
+        boolean setCalibrationPoints(uint8_t valueIndex, const int32_t* x, const int32_t* y, uint8_t count) {
+            if ((valueIndex >= cfgXmoduleSensor.dataValueCount) || !CalibrationTable::isValid(x, count))
+                return false;
+            dataCollection.processing.setCalibration(valueIndex, new CalibrationTable(x, y, count));
+            return true;
+        };
+
+        /**
+         * @brief Set a polynomial calibration of a value, replacing its scaling. The polynomial is evaluated once at 65
+         * points over the input range, conversion then interpolates in this table. A calibration saved on the device
+         * supersedes this one.
+         *
+         * @param valueIndex The index of the value.
+         * @param coefficients The coefficients c0 to cN of c0 + c1 * x + ... + cN * x^N, x is the sample with offset applied.
+         * @param degree The degree N, 1 to 3.
+         * @param from The lowest input, values below are clamped.
+         * @param to The highest input, values above are clamped.
+         * @return False if the index is out of range or the degree or range is invalid.
+         */
+        boolean setCalibrationPolynomial(uint8_t valueIndex, const float_t* coefficients, uint8_t degree, int32_t from, int32_t to) {
+            if ((valueIndex >= cfgXmoduleSensor.dataValueCount) || !CalibrationTable::isValid(degree, from, to))
+                return false;
+            dataCollection.processing.setCalibration(valueIndex, new CalibrationTable(coefficients, degree, from, to));
+            return true;
+        };
+
         /**
          * @brief Shift the decimal point of the sample values by the given exponent.
          *
          * @param _sampleToIntExponent The exponent array to shift the decimal point of the sample values.
          */
         void setSampleToIntExponent(int8_t *sampleToIntExponent) {
-            dataCollection.processing.setSampleToIntExponent(sampleToIntExponent);
+            dataCollection.processing.setSampleToIntExponent(sampleToIntExponent, dataCollection.sampleValueCount);
+        };
+
+        /**
+         * @brief Set the expression of a virtual channel after first compile. This value is superseeded by the user-set/saved value in the web interface.
+         *
+         * The expression is compiled once into a stack bytecode and evaluated for every sample, before filtering and
+         * averaging. It uses the values after the sample-to-int exponent, v1 for the first. Operators + - * / ^, parentheses,
+         * constants, and the functions abs, sqrt, log, exp, min, and max. The result is rounded to integer.
+         *
+         * @param virtualIndex The index of the virtual channel, starting with 0. It can use all values before it.
+         * @param expression The expression, for example "v1 - v2".
+         * @return False if the index is out of range or the expression is invalid.
+         */
+        boolean setVirtualChannel(uint8_t virtualIndex, const String& expression) {
+            return cfgXmoduleSensor.updateSingleValue("virtualChannel" + String(virtualIndex + 1), expression);
         };
 
 
@@ -237,24 +663,66 @@ class XmoduleSensor : public _Xmodule {
         bool measureScaling(uint8_t valueNumber, int32_t targetValue);
         void resetOffset();
         void resetScaling();
+        bool setCalibration(uint8_t valueNumber, const String& points);
+        void resetCalibration();
         void clearTare();
         void setTare();
+        void resetStatistics();
 
-    private:
+    protected:
 
         DataCollection dataCollection = DataCollection(&cfgXmoduleSensor.avgCountSample);
 
+        /**
+         * Call add with each sample index of a block and its micros time stamp, the last sample taken now, and handle
+         * finished averaging cycles.
+         */
+        template <typename F>
+        void addBlock(size_t count, uint32_t interval_us, F add) {
+            if (count == 0) {
+                return;
+            }
+            uint64_t nowMicros = DataCollection::getMicros64();
+            uint64_t age_us = (uint64_t)(count - 1) * interval_us;
+            for (size_t k = 0; k < count; k++) {
+                // Samples from before boot are stamped with boot
+                add(k, (age_us < nowMicros) ? nowMicros - age_us : 0);
+                if (dataCollection.avgCycleFinished) {
+                    handleAverage();
+                }
+                age_us -= interval_us;
+            }
+        }
+
+    private:
+
         String uriWebSocket;
         String mqttTopic;
+        String uriWebSocketEvent;
+        String mqttTopicEvent;
+        String uriWebSocketSpectrum;
+        String mqttTopicSpectrum;
 
         LimitTimer reportingTimer = LimitTimer(0);
 
+        uint64_t eventEpochOffset_ms = 0; // Of the kept event, downloads show the time stamps of the frame sent
+
+        // Reduced matrix output per output target, nullptr to send all values
+        static const uint8_t outputTargetCount = 3;
+        MatrixView* matrixViews[outputTargetCount] = { nullptr, nullptr, nullptr };
+
         // Offset and scaling
         boolean offsetRunning = false;
         boolean scalingRunning = false;
         int32_t scalingTargetValue;
         uint8_t scalingValueIndex;
 
+        void handleAverage();
+        boolean encodeAverage(String* lines); // Newest average into one line per output target, false if not reported
+        void handleEvent();
+        void handleSpectrum();
+        boolean setMatrixView(uint8_t target, const MatrixView::Settings& settings);
+        void outputLine(uint8_t target, const String& line);
         void measureOffsetScalingFinish();
 
         void networkCtrlCallback(const String& data); // Callback to receive control commands from MQTT and WebSocket
@@ -263,12 +731,154 @@ class XmoduleSensor : public _Xmodule {
         String webPageProcessor(uint8_t var);
         uint8_t webPageProcessorCount;
 
-        size_t csvRawResponseFiller(uint8_t* buffer, size_t maxLen, size_t index);
-        size_t csvLatestResponseFiller(uint8_t* buffer, size_t maxLen, size_t index);
-        size_t csvScaledResponseFiller(uint8_t* buffer, size_t maxLen, size_t index);
-        size_t csvExtendedResponseFiller(uint8_t* buffer, size_t maxLen, size_t index, boolean firstOnly, std::function<String()> stringFunc);
+        enum DownloadFormat: uint8_t {
+            CSV_RAW = 0,
+            CSV_SCALED = 1,
+            BINARY = 2, // Header and packed raw records, see encodeBinaryHeader()
+            EVENT = 3, // Lines of the kept event, see DataCollection::encodeEventLine()
+        };
+
+        /**
+         * Cursor of a single data download, each request has its own and is kept alive by the response filler.
+         *
+         * Samples are tracked by sequence number, the download stays valid while samples are added and evicted. Lines are
+         * encoded into a separate buffer and sent in parts if the response buffer is full. An event download counts lines
+         * of the kept event instead.
+         */
+        struct DataDownload {
+            uint8_t* line;
+            size_t lineLength = 0;
+            size_t linePos = 0; // Bytes of the line already sent
+            uint32_t sequence; // Next sample to encode
+            uint32_t sequenceEnd; // Samples added after the request started are not included
+            DownloadFormat format;
+            DataTier* tier = nullptr; // Download a tier instead of the full resolution data
+            uint64_t epochOffset_ms; // Fixed for the download, consistent time stamps even if the clock is adjusted meanwhile
+            uint32_t eventNumber = 0; // Kept event of an event download, sequence counts its lines
+
+            DataDownload(size_t lineMaxLength, uint32_t sequence, uint32_t sequenceEnd, DownloadFormat format, uint64_t epochOffset_ms) : sequence(sequence), sequenceEnd(sequenceEnd), format(format), epochOffset_ms(epochOffset_ms) {
+                line = new uint8_t[lineMaxLength];
+            }
+            ~DataDownload() { delete[] line; }
+
+            DataDownload(const DataDownload&) = delete;
+            DataDownload& operator=(const DataDownload&) = delete;
+        };
+
+        void sendDataResponse(AsyncWebServerRequest* request, const char* contentType, boolean latestOnly, DownloadFormat format, DataTier* tier = nullptr);
+        void selectDownloadRange(AsyncWebServerRequest* request, DataStore* dataStore, uint64_t epochOffset_ms, uint32_t& sequenceStart, uint32_t& sequenceEnd);
+        size_t dataResponseFiller(DataDownload& download, uint8_t* buffer, size_t maxLen);
+        void sendEventResponse(AsyncWebServerRequest* request);
+
+        // The header grows with the value count and the strings, it can exceed 64 kB
+        size_t getBinaryHeaderLength();
+        size_t encodeBinaryHeader(uint8_t* buffer);
 
         PGM_P getWebPage() override { return htmlXmoduleSensor; }
 };
 
+
+//////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Sensor module with the number of values and their type fixed at compile time.
+ *
+ * Conversion and averaging of new samples use fixed-size arrays, the compiler can unroll and inline the hot path.
+ * The averaged data is handed to the data collection of the runtime-sized sensor module, everything else is shared.
+ *
+ * @tparam N The number of values simultaneously coming from the sensor(s).
+ * @tparam T The numeric type of the sample, typically int or float.
+ */
+template <uint8_t N, typename T>
+class XmoduleSensorN : public XmoduleSensor {
+
+    public:
+
+        XmoduleSensorN(uint8_t virtualCount = 0) : XmoduleSensor(N, virtualCount) {
+            avgDataSum.fill(0);
+            sampleToIntMultiplier.fill(1);
+        };
+
+
+        /**
+         * @brief Add new data to the sensor module.
+         *
+         * @param newSample The new sample array of size N to add.
+         */
+        void addSample(const T *newSample) {
+            addSample(newSample, DataCollection::getMicros64());
+        };
+
+        /**
+         * @brief Add a block of samples at once, for sensors with a FIFO or block reads.
+         *
+         * @param block The samples one after the other, count times N values.
+         * @param count The number of samples in the block.
+         * @param interval_us The time between two samples in microseconds, the last sample is taken as read now.
+         */
+        void addSamples(const T *block, size_t count, uint32_t interval_us) {
+            addBlock(count, interval_us, [&](size_t k, uint64_t sampleMicros) {
+                addSample(&block[k * N], sampleMicros);
+            });
+        };
+
+        void addSample(const T *newSample, uint64_t sampleMicros) {
+            // Filter chain, event capture, spectra, and virtual channels need the runtime-sized path
+            if (dataCollection.needsSampleValues()) {
+                dataCollection.addSample(newSample, sampleMicros);
+                return;
+            }
+
+            // Averaging cycle restarted, also after a reset of the data collection
+            if (dataCollection.avgCounter == 0) {
+                avgDataSum.fill(0);
+                dataMax.fill(std::numeric_limits<int32_t>::min());
+                dataMin.fill(std::numeric_limits<int32_t>::max());
+            }
+
+            for (uint8_t i = 0; i < N; i++) {
+                // Shift decimal point and convert to int, integer samples without exponent need no float conversion
+                int32_t value;
+                if constexpr (std::is_integral<T>::value) {
+                    value = (sampleToIntMultiplier[i] == 1) ? (int32_t)newSample[i] : (int32_t)nearbyintf(sampleToIntMultiplier[i] * newSample[i]);
+                } else {
+                    value = nearbyintf(sampleToIntMultiplier[i] * newSample[i]);
+                }
+                avgDataSum[i] += value;
+                dataMax[i] = max(dataMax[i], value);
+                dataMin[i] = min(dataMin[i], value);
+            }
+
+            // Check if averaging count is reached, then calculate averages and store
+            if (dataCollection.countSample(sampleMicros)) {
+                for (uint8_t i = 0; i < N; i++) {
+                    avgDataSum[i] = avgDataSum[i] / *dataCollection.averagingCountPtr;
+                    // Extremes of the cycle into the all-time ones
+                    dataCollection.dataMax.values[i] = max(dataCollection.dataMax.values[i], dataMax[i]);
+                    dataCollection.dataMin.values[i] = min(dataCollection.dataMin.values[i], dataMin[i]);
+                }
+                dataCollection.appendAverage(avgDataSum.data());
+            }
+        };
+
+        /**
+         * @brief Shift the decimal point of the sample values by the given exponent.
+         *
+         * @param sampleToIntExponent The exponent array of size N to shift the decimal point of the sample values.
+         */
+        void setSampleToIntExponent(int8_t *sampleToIntExponent) {
+            XmoduleSensor::setSampleToIntExponent(sampleToIntExponent);
+            for (uint8_t i = 0; i < N; i++) {
+                sampleToIntMultiplier[i] = pow10(sampleToIntExponent[i]);
+            }
+        };
+
+    private:
+
+        std::array<int32_t, N> avgDataSum;
+        std::array<int32_t, N> dataMax; // Extremes of the current averaging cycle
+        std::array<int32_t, N> dataMin;
+        std::array<float_t, N> sampleToIntMultiplier; // Precomputed 10^exponent
+};
+
 #endif
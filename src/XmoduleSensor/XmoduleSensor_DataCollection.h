@@ -17,118 +17,637 @@ limitations under the License.
 #ifndef XMODULESENSOR_DATACOLLECTION
 #define XMODULESENSOR_DATACOLLECTION
 
+#include "XmoduleSensor_DataCollection_DataStore.h"
+#include "XmoduleSensor_DataCollection_Deadband.h"
+#include "XmoduleSensor_DataCollection_DataTier.h"
+#include "XmoduleSensor_DataCollection_EventCapture.h"
+#include "XmoduleSensor_DataCollection_Filter.h"
+#include "XmoduleSensor_DataCollection_MatrixView.h"
+#include "XmoduleSensor_DataCollection_Statistics.h"
 #include "XmoduleSensor_DataCollection_NumberArray.h"
+#include "XmoduleSensor_DataCollection_SampleQueue.h"
+#include "XmoduleSensor_DataCollection_Spectrum.h"
+#include "XmoduleSensor_DataCollection_VirtualChannel.h"
 #include "XmoduleSensor_DataProcessing.h"
 
 
 struct DataCollection {
 
-    /**
-     * Data structure to store sensor data and its millis time stamp.
-     */
-    struct DataStructSensor : NumberArray<int32_t> {
-        uint64_t millisStamp;
+    DataProcessing processing;
 
-        /**
-         * @brief Constructor for data structure.
-         *
-         * @param millisStamp Time of data
-         * @param values Pointer to data array
-         * @param _value_size Size of data array
-         */
-        DataStructSensor(uint64_t millisStamp, int32_t* values, uint8_t value_size) : NumberArray<int32_t>(values, value_size), millisStamp(millisStamp) { }
-    };
+    // Storing of averages with initial limit of 100 is reasonable on ESP8266
+    // The default linked list can grow automatically if memory is sufficient, a ring buffer has a fixed length
+    uint16_t dataStoreLength = 50;
+    DataStore* dataStore = nullptr;
 
-    /**
-     * Derived linked list to store sensor data and its millis time stamp.
-     */
-    struct LinkedListSensor : LinkedList3110<DataStructSensor> {
-        LinkedListSensor(uint16_t size) : LinkedList3110<DataStructSensor>(size) { }
+    // Downsampled history, optional
+    static const uint8_t dataTierCountMax = 4;
+    DataTier* dataTiers[dataTierCountMax];
+    uint8_t dataTierCount = 0;
 
-        void append(uint64_t millisStamp, NumberArrayLateInit<int32_t> *data) {
-            // Create data structure and add node to linked list
-            // Using this-> as base class/function is templated
-            this->appendDataStruct(new DataStructSensor(millisStamp, data->values, data->value_size));
-        }
+    // Reporting deadband around the last reported values
+    DataDeadband* deadband = nullptr;
 
-        String getBookmarkAsCsv(uint8_t columnCount, DataProcessing *processing) { return nodeToCSV(bookmark, columnCount, processing); }
-        String getLatestAsCsv(uint8_t columnCount, DataProcessing *processing) { return nodeToCSV(tail, columnCount, processing); }
-        String getLatestAsCsvNoTime(uint8_t columnCount, DataProcessing *processing) { return nodeToCSV(tail, columnCount, processing, false); }
+    // Online statistics, optional
+    DataStatistics* statistics = nullptr;
 
-        String nodeToCSV(Node* node, uint8_t columnCount, DataProcessing *processing, boolean withTime = true) {
-            // Return emty string if node is empty
-            if (node == nullptr) {
-                return "";
-            }
-            String str;
-            if (withTime) {
-                str += String(_helper.millisStampToEpoch_ms(node->dataStruct->millisStamp));
-                str += ",";
-            }
-            for (uint8_t i = 0; i < node->dataStruct->value_size; i++) {
-                str += (processing == nullptr) ? node->dataStruct->values[i] : processing->applyProcessing(node->dataStruct->values[i], i);
-                str += (i == node->dataStruct->value_size - 1) || ((i + 1) % columnCount == 0) ? ";" : ",";
-            }
-            return str;
-        }
+    // Filter chain applied to every sample before averaging, optional
+    static const uint8_t dataFilterCountMax = 6;
+    DataFilter* dataFilters[dataFilterCountMax];
+    uint8_t dataFilterCount = 0;
+    NumberArrayLateInit<int32_t> filterValues; // Sample converted to int, filtered in place
 
-        boolean isAboveThreshold(uint16_t threshold, int16_t thresholdOnlySingleIndex, DataProcessing *processing) {
-            // Nothing to compare
-            if ((tail == nullptr) || (tail->prev == nullptr)) {
-                return true;
-            }
+    // Values coming with a sample, virtual channels computed from them follow, optional
+    uint8_t sampleValueCount = 0;
+    VirtualChannel* virtualChannels = nullptr;
+    uint8_t virtualChannelCount = 0;
+    float_t virtualStack[VirtualChannel::stackDepthMax]; // Shared by all channels, evaluated one after the other
 
-            for (uint8_t i = 0; i < tail->dataStruct->value_size; i++) {
-                if (thresholdOnlySingleIndex >= 0 && i != thresholdOnlySingleIndex) {
-                    continue;
-                }
-                // Use floats, ints distort: 10 * 999/1000 -> 9.99 -> 9 --> 8 (-2) OK    vs.    10 * 1001/1000 -> 10.01 -> 10 --> 11 (+1) OK
-                float_t thisValue = processing->applyProcessing(tail->dataStruct->values[i], i);
-                float_t prevValue = processing->applyProcessing(tail->prev->dataStruct->values[i], i);
-                // One value beating threshold is enough
-                if (!isInRange(thisValue, prevValue * (1000 - threshold) / 1000, prevValue * (1000 + threshold) / 1000))
-                    return true;
-            }
+    // Capture of events in the raw samples, optional
+    EventCapture* eventCapture = nullptr;
+    // Free heap left to web server and network after enabling event capture
+    static const uint16_t eventHeapReserve = 16384;
 
-            // No value above threshold, remove the tail node
-            _removeNode(tail);
-            return false;
-        }
+    // Spectra of single values over blocks of raw samples, optional
+    static const uint8_t spectrumCountMax = 4;
+    DataSpectrum* spectra[spectrumCountMax];
+    uint8_t spectrumCount = 0;
 
-        void removeLast() {
-            if (tail != nullptr) {
-                _removeNode(tail);
-            }
-        }
-    };
-
-    DataProcessing processing;
-
-    // Storing of averages with initial limit of 100 is reasonable on ESP8266
-    // The list grows automatically if memory is sufficient
-    uint16_t dataStoreLength = 50;
-    LinkedListSensor linkedListSensor = LinkedListSensor(dataStoreLength);
+    // Queue of samples added from an interrupt or the other core, optional
+    SampleQueue* sampleQueue = nullptr;
 
     // Averaging
     NumberArrayLateInit<int32_t> avgDataSum; // Temporary data storage for averaging
     uint8_t *averagingCountPtr; // Pointer to cfgXmoduleSensor
     uint8_t avgCounter = 0; // Counter for averaging
-    int64_t avgStartTime = 0; // Time of first measurement in averaging cycle
+    uint64_t avgStartTime = 0; // Micros time of first measurement in averaging cycle
+    uint64_t avgEndTime = 0; // Micros time of latest measurement in averaging cycle
     boolean avgCycleFinished = false; // Flag for new data added to dataStore
 
     // Data statistics
     NumberArrayLateInit<int32_t> dataMax;
     NumberArrayLateInit<int32_t> dataMin;
 
+    // Processed values of the two most recently used samples, the newest sample is processed once for all outputs
+    // Two slots, a pointer stays valid until the second next call
+    struct ProcessedCache {
+        NumberArrayLateInit<int32_t> values;
+        uint32_t sequence;
+        uint16_t revision;
+        boolean valid = false;
+    };
+    ProcessedCache processedCache[2];
+    uint8_t processedCacheNext = 0; // Least recently used slot, overwritten next
+
+    // Reusable CSV line of a single sample: time stamp and separator, per value sign, 10 digits and separator, termination
+    char* csvLine = nullptr; // Size given by getEventLineMaxLength(), at least getCsvLineMaxLength()
+    uint16_t csvLineTimeLength = 0; // Length of time stamp and separator, the line without time starts there
+
+    // The web server of the ESP32 runs in its own task, possibly on the other core, and reads the stores, the processed
+    // cache, statistics, the kept event, and spectrum results while the loop updates them, and sets virtual channels
+    // while the loop evaluates them. Recursive, the loop holds it for a whole reporting cycle until the output is
+    // encoded, sending to the targets happens after it is released.
+    // The ESP8266 runs the web server from the loop, no lock is needed.
+#if defined(ESP32)
+    SemaphoreHandle_t storeMutex = xSemaphoreCreateRecursiveMutex();
+    void lockStore() { xSemaphoreTakeRecursive(storeMutex, portMAX_DELAY); }
+    void unlockStore() { xSemaphoreGiveRecursive(storeMutex); }
+#else
+    void lockStore() { }
+    void unlockStore() { }
+#endif
+
+    /** Holds the store lock for its scope. */
+    struct StoreLock {
+        DataCollection& dataCollection;
+        StoreLock(DataCollection& dataCollection) : dataCollection(dataCollection) { dataCollection.lockStore(); }
+        ~StoreLock() { dataCollection.unlockStore(); }
+        StoreLock(const StoreLock&) = delete;
+        StoreLock& operator=(const StoreLock&) = delete;
+    };
+
 
     DataCollection(uint8_t *averagingCount) : averagingCountPtr(averagingCount) { };
 
     void initDataValueSize(uint8_t dataValueSize) {
         processing.initDataValueSize(dataValueSize);
+        sampleValueCount = dataValueSize;
         // Init all NumberArrayLateInits
         avgDataSum.lateInit(dataValueSize, 0);
+        filterValues.lateInit(dataValueSize, 0);
         dataMax.lateInit(dataValueSize, std::numeric_limits<int32_t>::min());
         dataMin.lateInit(dataValueSize, std::numeric_limits<int32_t>::max());
+        processedCache[0].values.lateInit(dataValueSize, 0);
+        processedCache[1].values.lateInit(dataValueSize, 0);
+        delete deadband;
+        deadband = new DataDeadband(dataValueSize);
+        delete[] csvLine;
+        csvLine = new char[max(getCsvLineMaxLength(dataValueSize), (uint16_t)eventHeaderLengthMax)];
+        // Default store
+        delete dataStore;
+        dataStore = new DataStoreLinkedList(dataValueSize, dataStoreLength);
+    }
+
+    /**
+     * Replace the linked list store by a ring buffer of fixed length, optionally in columnar layout. Existing data is discarded.
+     * A length of zero is rejected, the store is kept then.
+     */
+    boolean useRingBuffer(uint16_t length, boolean columnar) {
+        if (length == 0) {
+            return false;
+        }
+        dataStoreLength = length;
+        delete dataStore;
+        if (columnar) {
+            dataStore = new DataStoreColumnar(avgDataSum.value_size, dataStoreLength);
+        } else {
+            dataStore = new DataStoreRingBuffer(avgDataSum.value_size, dataStoreLength);
+        }
+        return true;
+    }
+
+    /**
+     * Replace the store by a compressed ring of fixed-size blocks. Existing data is discarded.
+     * Less than two blocks or blocks too small for a sample are rejected, the store is kept then.
+     */
+    boolean useCompressed(uint16_t blockSize, uint16_t blockCount) {
+        if (!DataStoreCompressed::isValid(avgDataSum.value_size, blockSize, blockCount)) {
+            return false;
+        }
+        delete dataStore;
+        dataStore = new DataStoreCompressed(avgDataSum.value_size, blockSize, blockCount);
+        return true;
+    }
+
+    /**
+     * Add a downsampled tier stored in a ring buffer of fixed length.
+     *
+     * @return False if the maximum number of tiers is reached or there are more than 85 values.
+     */
+    boolean addDataTier(uint32_t interval_ms, uint16_t length) {
+        if (!canAddDataTier(interval_ms)) {
+            return false;
+        }
+        dataTiers[dataTierCount++] = new DataTier(interval_ms, avgDataSum.value_size, new DataStoreRingBuffer(3 * avgDataSum.value_size, length));
+        return true;
+    }
+
+    /**
+     * Add a downsampled tier stored compressed in a ring of fixed-size blocks.
+     *
+     * @return False if the maximum number of tiers is reached, there are more than 85 values, or the blocks are invalid.
+     */
+    boolean addDataTierCompressed(uint32_t interval_ms, uint16_t blockCount, uint16_t blockSize) {
+        if (!canAddDataTier(interval_ms) || !DataStoreCompressed::isValid(3 * avgDataSum.value_size, blockSize, blockCount)) {
+            return false;
+        }
+        dataTiers[dataTierCount++] = new DataTier(interval_ms, avgDataSum.value_size, new DataStoreCompressed(3 * avgDataSum.value_size, blockSize, blockCount));
+        return true;
+    }
+
+    boolean canAddDataTier(uint32_t interval_ms) {
+        // Mean, minimum, and maximum of each value in one row of the store
+        return (dataTierCount < dataTierCountMax) && (3 * avgDataSum.value_size <= 255) && (interval_ms > 0);
+    }
+
+    /**
+     * Append a stage to the filter chain.
+     *
+     * @return False if the maximum number of stages is reached, the stage is deleted then.
+     */
+    boolean addFilter(DataFilter* filter) {
+        if (dataFilterCount >= dataFilterCountMax) {
+            delete filter;
+            return false;
+        }
+        dataFilters[dataFilterCount++] = filter;
+        return true;
+    }
+
+    /**
+     * Apply the filter chain to the sample in filterValues.
+     *
+     * @return False if a stage dropped the sample.
+     */
+    boolean applyFilters() {
+        for (uint8_t i = 0; i < dataFilterCount; i++) {
+            if (!dataFilters[i]->apply(filterValues.values)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Enable event capture with the given number of samples before and after the trigger sample. A previous capture
+     * and its triggers are replaced.
+     *
+     * @return False if the ring exceeds 65535 samples or both rings would leave less than eventHeapReserve bytes of free
+     *  heap.
+     */
+    boolean enableEventCapture(uint16_t preCount, uint16_t postCount) {
+        if (!EventCapture::isValid(avgDataSum.value_size, preCount, postCount)) {
+            return false;
+        }
+        // The previous capture is freed before the new one is allocated
+        uint32_t freeHeap = ESP.getFreeHeap();
+        if (eventCapture != nullptr) {
+            freeHeap += EventCapture::getMemoryBytes(eventCapture->valueCount, eventCapture->preCount, eventCapture->postCount);
+        }
+        if (EventCapture::getMemoryBytes(avgDataSum.value_size, preCount, postCount) + eventHeapReserve > freeHeap) {
+            return false;
+        }
+        delete eventCapture;
+        eventCapture = new EventCapture(avgDataSum.value_size, preCount, postCount);
+        return true;
+    }
+
+    /**
+     * Encode the kept event as one frame, the lines of encodeEventLine() each followed by a line break. The length is
+     * counted first, the frame is allocated once.
+     *
+     * @return False if the frame does not fit into the heap.
+     */
+    boolean encodeEvent(String& frame, uint8_t columnCount, uint64_t epochOffset_ms) {
+        uint32_t lineCount = eventCapture->keptSize + 1;
+        size_t length = 0;
+        for (uint32_t line = 0; line < lineCount; line++) {
+            length += encodeEventLine(csvLine, line, columnCount, epochOffset_ms) + 1;
+        }
+        if (!frame.reserve(length)) {
+            return false;
+        }
+        for (uint32_t line = 0; line < lineCount; line++) {
+            uint16_t lineLength = encodeEventLine(csvLine, line, columnCount, epochOffset_ms);
+            csvLine[lineLength] = '\0';
+            frame += csvLine;
+            frame += '\n';
+        }
+        return true;
+    }
+
+    /**
+     * Encode a line of the kept event with offset, scaling, and tare applied, without line break. Line 0 has the epoch
+     * time of the trigger in ms, the number of the trigger, and the sample count. Each sample follows as CSV line with
+     * the time relative to the trigger in us.
+     *
+     * @param buffer Buffer of at least getEventLineMaxLength() - 1 characters.
+     * @param line Line number, up to the sample count.
+     * @return The number of characters written.
+     */
+    uint16_t encodeEventLine(char* buffer, uint16_t line, uint8_t columnCount, uint64_t epochOffset_ms) {
+        uint64_t triggerStamp = eventCapture->getKeptMicrosStamp(eventCapture->keptTriggerPos);
+        if (line == 0) {
+            memcpy(buffer, "event,", 6);
+            uint16_t pos = 6;
+            pos += _helper.printInt(buffer + pos, epochOffset_ms + triggerStamp / 1000);
+            buffer[pos++] = ',';
+            pos += _helper.printInt(buffer + pos, eventCapture->keptTriggerIndex);
+            buffer[pos++] = ',';
+            pos += _helper.printInt(buffer + pos, eventCapture->keptSize);
+            return pos;
+        }
+        int32_t* values = eventCapture->getKeptValues(line - 1);
+        int32_t* processed = getProcessedScratch();
+        for (uint8_t i = 0; i < avgDataSum.value_size; i++) {
+            processed[i] = processing.applyProcessing(values[i], i);
+        }
+        return encodeCsvValues(buffer, (int64_t)(eventCapture->getKeptMicrosStamp(line - 1) - triggerStamp), processed, avgDataSum.value_size, columnCount);
+    }
+
+    // First line of an event: "event,", epoch time stamp, trigger number, sample count, line break or termination
+    static const uint16_t eventHeaderLengthMax = 6 + 20 + 1 + 3 + 1 + 5 + 1;
+    uint16_t getEventLineMaxLength() { return max(getCsvLineMaxLength(), (uint16_t)eventHeaderLengthMax); }
+
+    /**
+     * Add a spectrum of a single value over blocks of raw samples.
+     *
+     * @return False if the maximum number of spectra is reached, the index is out of range, or block size or band count
+     *  are invalid.
+     */
+    boolean addSpectrum(uint8_t valueIndex, uint16_t blockSize, uint8_t bandCount, uint32_t interval_ms) {
+        if ((spectrumCount >= spectrumCountMax) || (valueIndex >= avgDataSum.value_size) || !DataSpectrum::isValid(blockSize, bandCount)) {
+            return false;
+        }
+        spectra[spectrumCount++] = new DataSpectrum(valueIndex, blockSize, bandCount, interval_ms);
+        return true;
+    }
+
+    /**
+     * Encode the latest result of a spectrum as JSON with the scaling applied. Band RMS and peak amplitude are
+     * differences to the mean, the offset does not apply to them and a calibration table by its slope at the mean.
+     */
+    String getSpectrumJson(uint8_t index, uint64_t epochOffset_ms) {
+        DataSpectrum* spectrum = spectra[index];
+        uint8_t i = spectrum->valueIndex;
+        CalibrationTable* calibration = processing.calibrations[i];
+        double_t slope = fabs((calibration != nullptr) ? calibration->getSlope((double_t)spectrum->mean + processing.offset.values[i]) : processing.scaling.values[i]);
+        char buffer[160];
+        uint16_t length = _helper.printInt(buffer, epochOffset_ms + spectrum->resultMicros / 1000);
+        buffer[length] = '\0';
+        String json = "{\"value\":" + String(i + 1) + ",\"time\":" + buffer;
+        snprintf(buffer, sizeof(buffer), ",\"count\":%u,\"blockSize\":%u,\"sampleRate\":%.3f,\"mean\":%d,\"peakFrequency\":%.3f,\"peakAmplitude\":%.2f,\"bandWidth\":%.3f,\"bands\":[",
+            (unsigned int)spectrum->count, spectrum->blockSize, spectrum->sampleRate, (int)processing.applyProcessing(spectrum->mean, i),
+            spectrum->peakFrequency, spectrum->peakAmplitude * slope, spectrum->getBandWidth());
+        json += buffer;
+        for (uint8_t b = 0; b < spectrum->bandCount; b++) {
+            snprintf(buffer, sizeof(buffer), "%s%.2f", (b > 0) ? "," : "", spectrum->bandRms[b] * slope);
+            json += buffer;
+        }
+        json += "]}";
+        return json;
+    }
+
+    /**
+     * Use the last values as virtual channels, the others come with a sample. Channels evaluate to 0 until set.
+     */
+    void initVirtualChannels(uint8_t count) {
+        delete[] virtualChannels;
+        virtualChannels = new VirtualChannel[count];
+        virtualChannelCount = count;
+        sampleValueCount = avgDataSum.value_size - count;
+    }
+
+    /**
+     * Compile the expression of a virtual channel, it can use the sample values and the virtual channels before it.
+     *
+     * @return False if the expression is invalid, the channel is kept unchanged then.
+     */
+    boolean setVirtualChannel(uint8_t index, const char* expression) {
+        VirtualChannel compiled;
+        if ((index >= virtualChannelCount) || !compiled.compile(expression, sampleValueCount + index)) {
+            return false;
+        }
+        // The web server of the ESP32 sets expressions from its own task, a channel is not replaced while evaluated
+        StoreLock lock(*this);
+        virtualChannels[index] = compiled;
+        return true;
+    }
+
+    /**
+     * Enable the sample queue, the length is rounded up to a power of two.
+     */
+    void enableSampleQueue(uint16_t length) {
+        delete sampleQueue;
+        sampleQueue = new SampleQueue(sampleValueCount, length);
+    }
+
+    /**
+     * Move the oldest queued sample to averaging, its 32-bit time stamp is extended relative to now.
+     *
+     * @return False if the queue is empty.
+     */
+    boolean drainSample(uint64_t nowMicros) {
+        uint32_t stamp_us;
+        int32_t* sample = sampleQueue->peek(stamp_us);
+        if (sample == nullptr) {
+            return false;
+        }
+        // Samples from before boot are stamped with boot, samples stamped after now with now
+        // The age is signed, a stamp shortly after now does not wrap to an age of 71 minutes
+        int32_t age_us = max((int32_t)((uint32_t)nowMicros - stamp_us), (int32_t)0);
+        addSample(sample, ((uint64_t)age_us < nowMicros) ? nowMicros - age_us : 0);
+        sampleQueue->release();
+        return true;
+    }
+
+    /**
+     * Enable online statistics of each value, windowed minimum and maximum over the given number of samples.
+     */
+    void enableStatistics(uint16_t window) {
+        delete statistics;
+        statistics = new DataStatistics(avgDataSum.value_size, window);
+    }
+
+    /**
+     * Consolidate the newest sample into all tiers and the statistics.
+     */
+    void consolidateNewest() {
+        StoreLock lock(*this);
+        if (((dataTierCount == 0) && (statistics == nullptr)) || (dataStore->getSize() == 0)) {
+            return;
+        }
+        uint16_t newest = dataStore->getSize() - 1;
+        int32_t* values = dataStore->getValues(newest);
+        uint64_t microsStamp = dataStore->getMicrosStamp(newest);
+        for (uint8_t i = 0; i < dataTierCount; i++) {
+            dataTiers[i]->add(microsStamp, values);
+        }
+        if (statistics != nullptr) {
+            statistics->add(values);
+        }
+    }
+
+    /**
+     * Get the statistics as JSON with offset, scaling, and tare applied.
+     */
+    String getStatisticsJson() {
+        // Called from the web server and WebSocket, on the ESP32 in parallel to consolidateNewest()
+        StoreLock lock(*this);
+        if (statistics == nullptr) {
+            return "{}";
+        }
+        // A channel can exceed the length limit of printFormatted
+        char buffer[320];
+        snprintf(buffer, sizeof(buffer), "{\"count\":%u,\"window\":%u,\"values\":[", (unsigned int)statistics->count, statistics->window);
+        String json = buffer;
+        for (uint8_t i = 0; (i < statistics->valueCount) && (statistics->count > 0); i++) {
+            DataStatistics::Channel& channel = statistics->channels[i];
+            // Negative scaling turns minima into maxima and lower into upper quantiles
+            // A calibration table is evaluated at the input, the standard deviation uses its slope at the mean
+            CalibrationTable* calibration = processing.calibrations[i];
+            boolean swap = (calibration != nullptr) ? calibration->isDecreasing() : processing.scaling.values[i] < 0;
+            auto scale = [&](double_t value) -> double_t {
+                if (calibration != nullptr) {
+                    return calibration->applyFloat(value + processing.offset.values[i]) + processing.tare.values[i];
+                }
+                return (value + processing.offset.values[i]) * processing.scaling.values[i] + processing.tare.values[i];
+            };
+            double_t slope = (calibration != nullptr) ? calibration->getSlope(channel.mean + processing.offset.values[i]) : processing.scaling.values[i];
+            double_t min = scale((swap) ? channel.max : channel.min);
+            double_t max = scale((swap) ? channel.min : channel.max);
+            double_t windowMin = scale((swap) ? channel.windowMax.get() : channel.windowMin.get());
+            double_t windowMax = scale((swap) ? channel.windowMin.get() : channel.windowMax.get());
+            double_t p05 = scale(channel.quantiles[(swap) ? 2 : 0].get());
+            double_t p95 = scale(channel.quantiles[(swap) ? 0 : 2].get());
+            snprintf(buffer, sizeof(buffer), "%s{\"mean\":%.2f,\"stdDev\":%.2f,\"min\":%.0f,\"max\":%.0f,\"windowMin\":%.0f,\"windowMax\":%.0f,\"p05\":%.1f,\"median\":%.1f,\"p95\":%.1f}",
+                (i > 0) ? "," : "", scale(channel.mean), statistics->getStdDev(i) * fabs(slope),
+                min, max, windowMin, windowMax, p05, scale(channel.quantiles[1].get()), p95);
+            json += buffer;
+        }
+        json += "]}";
+        return json;
+    }
+
+
+//////////////////////////////////////////////////////////////////////////////////
+
+    /**
+     * Get the values of the sample at the given index with offset, scaling, and tare applied.
+     * The result is cached until the processing changes, the pointer is valid until the second next call.
+     */
+    int32_t* getProcessedValues(uint16_t index) {
+        uint32_t sequence = dataStore->getSequence(index);
+        for (uint8_t slot = 0; slot < 2; slot++) {
+            ProcessedCache& cache = processedCache[slot];
+            if (cache.valid && (cache.sequence == sequence) && (cache.revision == processing.revision)) {
+                processedCacheNext = 1 - slot;
+                return cache.values.values;
+            }
+        }
+        // Not cached, process into the least recently used slot
+        ProcessedCache& cache = processedCache[processedCacheNext];
+        int32_t* values = dataStore->getValues(index);
+        for (uint8_t i = 0; i < dataStore->valueCount; i++) {
+            cache.values.values[i] = processing.applyProcessing(values[i], i);
+        }
+        cache.sequence = sequence;
+        cache.revision = processing.revision;
+        cache.valid = true;
+        processedCacheNext = 1 - processedCacheNext;
+        return cache.values.values;
+    }
+
+    /**
+     * Get the least recently used slot of the processed cache for values not in the store, for example of an event.
+     * The slot is invalidated, the pointer is valid until the second next call.
+     */
+    int32_t* getProcessedScratch() {
+        ProcessedCache& cache = processedCache[processedCacheNext];
+        cache.valid = false;
+        processedCacheNext = 1 - processedCacheNext;
+        return cache.values.values;
+    }
+
+    void removeNewest() {
+        StoreLock lock(*this);
+        // The sequence number of the removed sample is reused by the next one
+        processedCache[0].valid = false;
+        processedCache[1].valid = false;
+        dataStore->removeNewest();
+    }
+
+    String getLatestAsCsv(uint8_t columnCount, boolean processed) {
+        // Return empty string if there is no data
+        if (dataStore->getSize() == 0) {
+            return "";
+        }
+        return encodeCsvLine(dataStore->getSize() - 1, columnCount, processed);
+    }
+
+    /**
+     * Encode the sample at the given index as CSV line into the reusable line buffer.
+     * The line without time stamp starts at csvLine + csvLineTimeLength. Valid until the next call.
+     *
+     * @return The zero-terminated line.
+     */
+    const char* encodeCsvLine(uint16_t index, uint8_t columnCount, boolean processed) {
+        uint16_t pos = encodeCsv(csvLine, index, columnCount, processed, _helper.millisStampToEpoch_ms(0), &csvLineTimeLength);
+        csvLine[pos] = '\0';
+        return csvLine;
+    }
+
+    /**
+     * Encode the sample at the given index as CSV into a buffer, without terminating zero or line break.
+     *
+     * @param buffer Buffer of at least getCsvLineMaxLength() - 1 characters.
+     * @param epochOffset_ms Offset to convert the time stamp to epoch time, from millisStampToEpoch_ms(0).
+     * @param timeLength (optional) Set to the length of the time stamp and separator.
+     * @return The number of characters written.
+     */
+    uint16_t encodeCsv(char* buffer, uint16_t index, uint8_t columnCount, boolean processed, uint64_t epochOffset_ms, uint16_t* timeLength = nullptr) {
+        int32_t* values = (processed) ? getProcessedValues(index) : dataStore->getValues(index);
+        return encodeCsvValues(buffer, epochOffset_ms + dataStore->getMicrosStamp(index) / 1000, values, dataStore->valueCount, columnCount, timeLength);
+    }
+
+    /**
+     * Encode the row at the given index of a tier as CSV, means, minima, and maxima each end with ';'.
+     */
+    uint16_t encodeCsv(char* buffer, DataTier* tier, uint16_t index, uint8_t columnCount, boolean processed, uint64_t epochOffset_ms) {
+        int32_t* values = (processed) ? tier->getProcessedValues(index, processing) : tier->dataStore->getValues(index);
+        return encodeCsvValues(buffer, epochOffset_ms + tier->dataStore->getMicrosStamp(index) / 1000, values, tier->dataStore->valueCount, min(columnCount, tier->valueCount));
+    }
+
+    uint16_t encodeCsvValues(char* buffer, int64_t epochStamp_ms, int32_t* values, uint8_t valueCount, uint8_t columnCount, uint16_t* timeLength = nullptr) {
+        uint16_t pos = _helper.printInt(buffer, epochStamp_ms);
+        buffer[pos++] = ',';
+        if (timeLength != nullptr) {
+            *timeLength = pos;
+        }
+        for (uint8_t i = 0; i < valueCount; i++) {
+            pos += _helper.printInt(buffer + pos, values[i]);
+            buffer[pos++] = (i == valueCount - 1) || ((i + 1) % columnCount == 0) ? ';' : ',';
+        }
+        return pos;
+    }
+
+    /**
+     * Encode the raw sample at the given index as packed little-endian record.
+     *
+     *  uint32   sequence number, gaps show samples skipped during the download
+     *  int64    epoch time stamp [us]
+     *  int32[]  raw values
+     *
+     * @param buffer Buffer of at least getBinaryRecordLength() bytes.
+     * @param epochOffset_ms Offset to convert the time stamp to epoch time, from millisStampToEpoch_ms(0).
+     * @return The number of bytes written.
+     */
+    uint16_t encodeBinary(uint8_t* buffer, uint16_t index, uint64_t epochOffset_ms) {
+        // ESP8266 and ESP32 are little-endian, no conversion needed
+        uint32_t sequence = dataStore->getSequence(index);
+        int64_t epochStamp_us = epochOffset_ms * 1000 + dataStore->getMicrosStamp(index);
+        memcpy(buffer, &sequence, 4);
+        memcpy(buffer + 4, &epochStamp_us, 8);
+        memcpy(buffer + 12, dataStore->getValues(index), 4 * dataStore->valueCount);
+        return getBinaryRecordLength();
+    }
+
+    uint16_t getBinaryRecordLength() { return 12 + 4 * avgDataSum.value_size; }
+
+    uint16_t getCsvLineMaxLength(uint16_t dataValueSize) { return 21 + 12 * dataValueSize + 1; }
+    uint16_t getCsvLineMaxLength() { return getCsvLineMaxLength(avgDataSum.value_size); }
+
+    /**
+     * Check if the newest sample is to be reported: a value left its deadband around the last reported value, or the
+     * heartbeat is due. Otherwise the newest sample is removed.
+     *
+     * @param defaultBand Band of values without a band of their own.
+     * @param onlySingleIndex Check only the value with this index, -1 for all values.
+     * @param heartbeat_ms Maximum interval between reports, 0 to disable.
+     */
+    boolean isOutsideDeadband(const DataDeadband::Band& defaultBand, int16_t onlySingleIndex, uint32_t heartbeat_ms) {
+        uint16_t size = dataStore->getSize();
+        if ((size == 0) || deadband->isDue(dataStore->getMicrosStamp(size - 1), processing.revision, heartbeat_ms)) {
+            return true;
+        }
+
+        if ((onlySingleIndex >= 0) && (onlySingleIndex < dataStore->valueCount)) {
+            // Single value access, the columnar store does not need to gather the whole sample
+            uint8_t i = onlySingleIndex;
+            if (deadband->isOutside(i, processing.applyProcessing(dataStore->getValue(size - 1, i), i), defaultBand))
+                return true;
+        } else {
+            int32_t* values = getProcessedValues(size - 1);
+            for (uint8_t i = 0; i < dataStore->valueCount; i++) {
+                // One value leaving its band is enough
+                if (deadband->isOutside(i, values[i], defaultBand))
+                    return true;
+            }
+        }
+
+        // No value outside its band, remove the newest
+        removeNewest();
+        return false;
+    }
+
+    /**
+     * The newest sample was reported, it is the new reference of the deadband.
+     */
+    void setDeadbandReference() {
+        uint16_t size = dataStore->getSize();
+        if (size > 0) {
+            deadband->setReference(getProcessedValues(size - 1), dataStore->getMicrosStamp(size - 1), processing.revision);
+        }
     }
 
 
@@ -151,47 +670,140 @@ struct DataCollection {
         avgStartTime = 0;
         avgCycleFinished = false;
 
+        // Filter state
+        for (uint8_t i = 0; i < dataFilterCount; i++) {
+            dataFilters[i]->reset();
+        }
+
         // Data storage
-        linkedListSensor.clear();
+        StoreLock lock(*this);
+        dataStore->clear();
+    }
+
+    /**
+     * Microseconds since boot, 64 bit does not wrap. Same origin as millis().
+     */
+    static uint64_t getMicros64() {
+#if defined(ESP8266)
+        return micros64();
+#else
+        return esp_timer_get_time();
+#endif
     }
 
     template <typename T>
-    void addSample(T* newSample)  {
-        // This is the function to do most of the work
+    void addSample(T* newSample) {
+        addSample(newSample, getMicros64());
+    }
 
-        // Chift decimal point and convert to int
-        int32_t* decimalShiftedSample = processing.applySampleToIntExponent(newSample); // IMPORTANT: delete array after use
+    template <typename T>
+    void addSample(T* newSample, uint64_t sampleMicros)  {
+        // This is the function to do most of the work, it is called for every single sample
+        // No heap allocation and a single pass over the values
+
+        if (needsSampleValues()) {
+            // Shift decimal point and convert to int, add virtual channels, capture events and spectra in these raw values, then filter
+            for (uint8_t i = 0; i < sampleValueCount; i++) {
+                filterValues.values[i] = processing.applySampleToIntExponent(newSample[i], i);
+            }
+            applyVirtualChannels(filterValues.values);
+            if (eventCapture != nullptr) {
+                eventCapture->add(sampleMicros, filterValues.values);
+            }
+            for (uint8_t s = 0; s < spectrumCount; s++) {
+                spectra[s]->add(sampleMicros, filterValues.values[spectra[s]->valueIndex]);
+            }
+            if (!applyFilters()) {
+                return;
+            }
+            for (uint8_t i = 0; i < avgDataSum.value_size; i++) {
+                addToAverage(i, filterValues.values[i]);
+            }
+        } else {
+            for (uint8_t i = 0; i < avgDataSum.value_size; i++) {
+                // Shift decimal point and convert to int
+                addToAverage(i, processing.applySampleToIntExponent(newSample[i], i));
+            }
+        }
 
-        // Add new values to existing sums, remember max/min extremes
-        avgDataSum.loopArray([&](int32_t& value, uint8_t i) { value += decimalShiftedSample[i]; } ); // Add new value for later averaging
-        dataMax.loopArray([&](int32_t& value, uint8_t i) { value = max(value, decimalShiftedSample[i]); } ); // All-time max
-        dataMin.loopArray([&](int32_t& value, uint8_t i) { value = min(value, decimalShiftedSample[i]); } ); // All-time min
+        // Check if averaging count is reached
+        if (countSample(sampleMicros)) {
+            // Calculate data averages
+            for (uint8_t i = 0; i < avgDataSum.value_size; i++) {
+                avgDataSum.values[i] = avgDataSum.values[i] / *averagingCountPtr;
+            }
+            // Store median time stamp and data
+            appendAverage(avgDataSum.values);
+
+            // Reset temporary values
+            avgDataSum.resetValues();
+        }
+    }
+
+    /**
+     * Filters, event capture, spectra, and virtual channels need the converted values of a sample as a whole.
+     */
+    boolean needsSampleValues() { return (dataFilterCount > 0) || (eventCapture != nullptr) || (spectrumCount > 0) || (virtualChannelCount > 0); }
+
+    void applyVirtualChannels(int32_t* values) {
+        if (virtualChannelCount == 0) {
+            return;
+        }
+        StoreLock lock(*this);
+        for (uint8_t k = 0; k < virtualChannelCount; k++) {
+            float_t value = virtualChannels[k].evaluate(values, virtualStack);
+            // Undefined and infinite results like x/0 give 0, overflow saturates
+            int32_t& result = values[sampleValueCount + k];
+            if (!std::isfinite(value)) {
+                result = 0;
+            } else if (value >= 2147483648.0f) {
+                result = std::numeric_limits<int32_t>::max();
+            } else if (value <= -2147483648.0f) {
+                result = std::numeric_limits<int32_t>::min();
+            } else {
+                result = nearbyintf(value);
+            }
+        }
+    }
 
+    void addToAverage(uint8_t i, int32_t value) {
+        // Add new value to existing sum for later averaging, remember max/min extremes
+        avgDataSum.values[i] += value;
+        dataMax.values[i] = max(dataMax.values[i], value); // All-time max
+        dataMin.values[i] = min(dataMin.values[i], value); // All-time min
+    }
+
+    /**
+     * Count a sample towards the averaging cycle.
+     *
+     * @return True if the averaging count is reached and the averages are to be appended.
+     */
+    boolean countSample(uint64_t sampleMicros) {
         // Averaging cycle restarted, init
         if (avgCounter == 0) {
-            avgStartTime =  millis();
+            avgStartTime = sampleMicros;
             avgCycleFinished = false;
         }
+        avgEndTime = sampleMicros;
         // Increment averaging head
         avgCounter++;
+        return avgCounter >= *averagingCountPtr;
+    }
 
-        // Check if averaging count is reached
-        if (avgCounter >= *averagingCountPtr) {
-
-            // Calculate data averages
-            avgDataSum.loopArray([&](int32_t& value, uint8_t i) { value = nearbyintf( value / *averagingCountPtr ); } );
-            // Store median millis time stamp and data in linked list
-            linkedListSensor.append((uint64_t)nearbyintf( (avgStartTime + millis()) / 2 ), &avgDataSum);
-
-            // Reset temporary values, counters
-            avgDataSum.resetValues();
-            avgCounter = 0;
-            avgStartTime = 0;
-            // Flag new data added for further actions in loop()
-            avgCycleFinished = true;
-        }
+    /**
+     * Store the averages with the median time stamp of the averaging cycle and restart the cycle.
+     */
+    void appendAverage(int32_t* averages) {
+        // Exact in integer, no overflow
+        lockStore();
+        dataStore->append(avgStartTime + (avgEndTime - avgStartTime) / 2, averages);
+        unlockStore();
 
-        delete[] decimalShiftedSample; // IMPORTANT: delete the array
+        // Reset counters
+        avgCounter = 0;
+        avgStartTime = 0;
+        // Flag new data added for further actions in loop()
+        avgCycleFinished = true;
     }
 };
 
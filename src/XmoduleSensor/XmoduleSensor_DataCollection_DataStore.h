@@ -0,0 +1,584 @@
+/*
+Copyright Production 3000
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef XMODULESENSOR_DATACOLLECTION_DATASTORE
+#define XMODULESENSOR_DATACOLLECTION_DATASTORE
+
+#include <Arduino.h>
+
+#include "_Helper_LinkedList.h"
+#include "XmoduleSensor_DataCollection_NumberArray.h"
+
+
+/**
+ * Interface of the history store for averaged sensor data.
+ *
+ * Samples are accessed by index, starting from zero with the oldest sample. Pointers returned by getValues() are only
+ * valid until the next call to the store.
+ */
+struct DataStore {
+
+    uint8_t valueCount;
+
+    // Sequence number of the next appended sample, identifies samples independent of their index
+    // Implementations increment on append and decrement on removeNewest, the number of the removed sample is reused
+    uint32_t sequenceNext = 0;
+
+    DataStore(uint8_t valueCount) : valueCount(valueCount) { }
+    virtual ~DataStore() { }
+
+    virtual void append(uint64_t microsStamp, int32_t* values) = 0;
+    virtual void clear() = 0;
+    virtual void removeNewest() = 0;
+
+    virtual uint16_t getSize() = 0;
+    virtual uint16_t getMaxSize() = 0;
+
+    virtual boolean isAdaptive() { return false; }
+    virtual const char* getTypeName() { return isAdaptive() ? "adaptive" : "fixed"; }
+    virtual void enableAdaptiveGrowing() { }
+
+    virtual uint64_t getMicrosStamp(uint16_t index) = 0;
+    virtual int32_t* getValues(uint16_t index) = 0;
+    virtual int32_t getValue(uint16_t index, uint8_t valueIndex) { return getValues(index)[valueIndex]; }
+
+    int32_t* getNewestValues() { return getValues(getSize() - 1); }
+
+    /**
+     * Find the first sample with a time stamp after the given one, time stamps are ascending.
+     *
+     * @return The index of the sample, or the size of the store if there is none.
+     */
+    virtual uint16_t findIndexAfter(uint64_t microsStamp) {
+        // Binary search, O(log n) for stores with O(1) access by index
+        uint16_t low = 0;
+        uint16_t high = getSize();
+        while (low < high) {
+            uint16_t middle = low + (high - low) / 2;
+            if (getMicrosStamp(middle) > microsStamp) {
+                high = middle;
+            } else {
+                low = middle + 1;
+            }
+        }
+        return low;
+    }
+
+    uint32_t getSequence(uint16_t index) { return sequenceNext - getSize() + index; }
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * History store as linked list, optionally growing with available memory.
+ */
+struct DataStoreLinkedList : DataStore {
+
+    /**
+     * Data structure to store sensor data and its micros time stamp.
+     */
+    struct DataStructSensor : NumberArray<int32_t> {
+        uint64_t microsStamp;
+
+        /**
+         * @brief Constructor for data structure.
+         *
+         * @param microsStamp Time of data
+         * @param values Pointer to data array
+         * @param _value_size Size of data array
+         */
+        DataStructSensor(uint64_t microsStamp, int32_t* values, uint8_t value_size) : NumberArray<int32_t>(values, value_size), microsStamp(microsStamp) { }
+
+        /**
+         * @brief Overwrite a recycled data structure in place, the size of the data array is unchanged.
+         *
+         * @param _microsStamp Time of data
+         * @param _values Pointer to data array
+         */
+        void update(uint64_t _microsStamp, int32_t* _values) {
+            microsStamp = _microsStamp;
+            for (uint8_t i = 0; i < value_size; i++) {
+                values[i] = _values[i];
+            }
+        }
+    };
+
+    /**
+     * Derived linked list to store sensor data and its micros time stamp.
+     */
+    struct LinkedListSensor : LinkedList3110<DataStructSensor> {
+        LinkedListSensor(uint16_t size) : LinkedList3110<DataStructSensor>(size) {
+            // Steady state of a full list does not allocate: nodes from the pool, data structures are recycled
+            this->enableNodePool(size);
+        }
+
+        uint16_t bookmarkIndex = 0; // Index of the bookmarked node, valid only if there is a bookmark
+
+        void append(uint64_t microsStamp, int32_t* values, uint8_t valueCount) {
+            // Reuse data structure of the oldest/a removed node, only create new one if there is none
+            // Using this-> as base class/function is templated
+            DataStructSensor* dataStruct = this->recycleDataStruct();
+            if (dataStruct == nullptr) {
+                dataStruct = new DataStructSensor(microsStamp, values, valueCount);
+            } else {
+                dataStruct->update(microsStamp, values);
+            }
+            this->appendDataStruct(dataStruct);
+        }
+
+        DataStructSensor* getDataByIndex(uint16_t index) {
+            // Newest is used most, and the only one not reachable by moving a bookmark from the start
+            if (index == this->size - 1) {
+                return this->getNewestData();
+            }
+            // Sequential access, only move the bookmark one step
+            if (!this->hasBookmark() || ((index != bookmarkIndex) && (index != bookmarkIndex + 1))) {
+                // Start search from the closer end
+                if (index < this->size / 2) {
+                    this->bookmarkByIndex(index);
+                } else {
+                    this->bookmarkByIndex(this->size - 1 - index, true);
+                }
+            } else if (index == bookmarkIndex + 1) {
+                this->moveBookmark();
+            }
+            bookmarkIndex = index;
+            return this->getBookmarkData();
+        }
+    };
+
+    LinkedListSensor linkedList;
+
+    DataStoreLinkedList(uint8_t valueCount, uint16_t size) : DataStore(valueCount), linkedList(size) { }
+
+    void append(uint64_t microsStamp, int32_t* values) {
+        linkedList.bookmark = nullptr; // Indices shift and the oldest node could be removed
+        linkedList.append(microsStamp, values, valueCount);
+        sequenceNext++;
+    }
+    void clear() {
+        linkedList.bookmark = nullptr;
+        linkedList.clear();
+    }
+    void removeNewest() {
+        if (linkedList.tail != nullptr) {
+            linkedList.bookmark = nullptr;
+            linkedList._removeNode(linkedList.tail);
+            sequenceNext--;
+        }
+    }
+
+    uint16_t getSize() { return linkedList.getSize(); }
+    uint16_t getMaxSize() { return linkedList.getMaxSize(); }
+
+    boolean isAdaptive() { return linkedList.isAdaptive(); }
+    void enableAdaptiveGrowing() { linkedList.enableAdaptiveGrowing(); }
+
+    uint64_t getMicrosStamp(uint16_t index) { return linkedList.getDataByIndex(index)->microsStamp; }
+    int32_t* getValues(uint16_t index) { return linkedList.getDataByIndex(index)->values; }
+
+    uint16_t findIndexAfter(uint64_t microsStamp) {
+        // Walk back from the newest, a binary search would walk the list for every probe
+        // Queries are mostly for recent data, this is O(1) for polling new samples
+        uint16_t index = linkedList.getSize();
+        linkedList.bookmark = linkedList.tail;
+        while ((linkedList.bookmark != nullptr) && (linkedList.getBookmarkData()->microsStamp > microsStamp)) {
+            linkedList.moveBookmark(true);
+            index--;
+        }
+        linkedList.bookmark = nullptr;
+        return index;
+    }
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * History store as ring buffer, time stamps and values in one contiguous preallocated block each.
+ *
+ * Removal of the oldest sample and access by index are O(1), there is no per sample overhead for nodes and pointers.
+ */
+struct DataStoreRingBuffer : DataStore {
+
+    uint64_t* microsStamps;
+    int32_t* values; // Row by row, valueCount values per sample
+
+    uint16_t capacity;
+    uint16_t head = 0; // Slot of the oldest sample
+    uint16_t size = 0;
+
+    DataStoreRingBuffer(uint8_t valueCount, uint16_t capacity) : DataStore(valueCount), capacity(capacity) {
+        microsStamps = new uint64_t[capacity];
+        values = new int32_t[capacity * valueCount];
+    }
+
+    ~DataStoreRingBuffer() {
+        delete[] microsStamps;
+        delete[] values;
+    }
+
+    uint16_t slot(uint16_t index) { return (head + index) % capacity; }
+
+    void append(uint64_t microsStamp, int32_t* newValues) {
+        // Full, overwrite the oldest
+        if (size >= capacity) {
+            head = (head + 1) % capacity;
+            size--;
+        }
+        uint16_t s = slot(size);
+        microsStamps[s] = microsStamp;
+        memcpy(values + s * valueCount, newValues, valueCount * sizeof(int32_t));
+        size++;
+        sequenceNext++;
+    }
+    void clear() {
+        head = 0;
+        size = 0;
+    }
+    void removeNewest() {
+        if (size > 0) {
+            size--;
+            sequenceNext--;
+        }
+    }
+
+    uint16_t getSize() { return size; }
+    uint16_t getMaxSize() { return capacity; }
+
+    uint64_t getMicrosStamp(uint16_t index) { return microsStamps[slot(index)]; }
+    int32_t* getValues(uint16_t index) { return values + slot(index) * valueCount; }
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * History store as ring buffer in columnar layout, the values of each channel are contiguous.
+ *
+ * Passes over a single channel, like the threshold check of a single value or per-channel statistics, are linear.
+ * Access to a complete sample gathers it into a temporary row.
+ */
+struct DataStoreColumnar : DataStoreRingBuffer {
+
+    int32_t* row; // Gathered sample returned by getValues()
+
+    // The inherited value block is used channel by channel, capacity values per channel
+    DataStoreColumnar(uint8_t valueCount, uint16_t capacity) : DataStoreRingBuffer(valueCount, capacity) {
+        row = new int32_t[valueCount];
+    }
+
+    ~DataStoreColumnar() {
+        delete[] row;
+    }
+
+    void append(uint64_t microsStamp, int32_t* newValues) {
+        // Full, overwrite the oldest
+        if (size >= capacity) {
+            head = (head + 1) % capacity;
+            size--;
+        }
+        uint16_t s = slot(size);
+        microsStamps[s] = microsStamp;
+        for (uint8_t i = 0; i < valueCount; i++) {
+            values[i * capacity + s] = newValues[i];
+        }
+        size++;
+        sequenceNext++;
+    }
+
+    int32_t* getValues(uint16_t index) {
+        uint16_t s = slot(index);
+        for (uint8_t i = 0; i < valueCount; i++) {
+            row[i] = values[i * capacity + s];
+        }
+        return row;
+    }
+    int32_t getValue(uint16_t index, uint8_t valueIndex) { return values[valueIndex * capacity + slot(index)]; }
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * History store compressed into a ring of fixed-size byte blocks.
+ *
+ * Each sample is stored as the delta of the time stamp and per value the delta to the previous sample, as zig-zag varints.
+ * Slowly changing signals need about one byte per value instead of four. Every block starts from zero, it can be decoded
+ * without the previous blocks and the oldest block is removed as a whole when space is needed.
+ *
+ * Samples are decoded on read. Sequential access and the newest sample are O(1), random access decodes from the start
+ * of the block.
+ */
+struct DataStoreCompressed : DataStore {
+
+    struct Block {
+        uint64_t microsStamp; // Base for the time stamp delta of the first sample
+        uint16_t count;
+        uint16_t length; // Bytes used
+    };
+
+    uint8_t* bytes; // blockCount blocks of blockSize bytes
+    Block* blocks;
+    uint16_t blockSize;
+    uint16_t blockCount;
+    uint16_t head = 0; // Block with the oldest samples
+    uint16_t usedBlocks = 0;
+    uint16_t size = 0;
+
+    // Newest sample, base of the next delta
+    int32_t* lastValues;
+    uint64_t lastStamp = 0;
+
+    // Encoded sample before it is copied into a block
+    uint8_t* encoded;
+
+    // State before the last append, to cheaply undo it with removeNewest()
+    int32_t* undoValues;
+    uint64_t undoStamp = 0;
+    uint16_t undoLength = 0;
+    boolean undoValid = false;
+
+    // Decoder position, the sample at cursorIndex is in cursorValues
+    int32_t* cursorValues;
+    uint64_t cursorStamp = 0;
+    uint16_t cursorIndex = 0;
+    uint16_t cursorBlock = 0;
+    uint16_t cursorBlockFirst = 0; // Index of the first sample in the cursor block
+    uint16_t cursorPos = 0; // Byte after the sample at cursorIndex
+    boolean cursorValid = false;
+
+    // Block size and count as checked by isValid()
+    DataStoreCompressed(uint8_t valueCount, uint16_t blockSize, uint16_t blockCount) : DataStore(valueCount), blockSize(blockSize), blockCount(blockCount) {
+        bytes = new uint8_t[this->blockSize * this->blockCount];
+        blocks = new Block[this->blockCount];
+        encoded = new uint8_t[getMaxSampleLength()];
+        lastValues = new int32_t[valueCount];
+        undoValues = new int32_t[valueCount];
+        cursorValues = new int32_t[valueCount];
+    }
+
+    ~DataStoreCompressed() {
+        delete[] bytes;
+        delete[] blocks;
+        delete[] encoded;
+        delete[] lastValues;
+        delete[] undoValues;
+        delete[] cursorValues;
+    }
+
+    uint16_t getMaxSampleLength() { return getMaxSampleLength(valueCount); }
+
+    /** Worst case of a sample: 10 bytes time stamp delta, 5 bytes per value. */
+    static uint16_t getMaxSampleLength(uint8_t valueCount) { return 10 + 5 * valueCount; }
+
+    /** A block holds at least one sample of the worst case, the oldest block is discarded so at least two are needed. */
+    static boolean isValid(uint8_t valueCount, uint16_t blockSize, uint16_t blockCount) {
+        return (blockSize >= getMaxSampleLength(valueCount)) && (blockCount >= 2);
+    }
+
+    uint16_t tail() { return (head + usedBlocks - 1) % blockCount; }
+    uint8_t* blockBytes(uint16_t block) { return bytes + block * blockSize; }
+
+    void append(uint64_t microsStamp, int32_t* newValues) {
+        // Save state for undo
+        memcpy(undoValues, lastValues, valueCount * sizeof(int32_t));
+        undoStamp = lastStamp;
+        undoLength = (usedBlocks > 0) ? blocks[tail()].length : 0;
+
+        // Encode as delta to the previous sample, start a new block if it does not fit
+        uint16_t length = (usedBlocks > 0) ? encode(microsStamp, newValues) : 0;
+        if ((usedBlocks == 0) || (blocks[tail()].length + length > blockSize)) {
+            openBlock(microsStamp);
+            length = encode(microsStamp, newValues);
+        }
+
+        Block& block = blocks[tail()];
+        memcpy(blockBytes(tail()) + block.length, encoded, length);
+        block.length += length;
+        block.count++;
+        memcpy(lastValues, newValues, valueCount * sizeof(int32_t));
+        lastStamp = microsStamp;
+
+        size++;
+        sequenceNext++;
+        undoValid = true;
+    }
+
+    void clear() {
+        head = 0;
+        usedBlocks = 0;
+        size = 0;
+        undoValid = false;
+        cursorValid = false;
+    }
+
+    void removeNewest() {
+        if (size == 0) {
+            return;
+        }
+        cursorValid = false;
+        size--;
+        sequenceNext--;
+
+        Block& block = blocks[tail()];
+        block.count--;
+        if (block.count == 0) {
+            usedBlocks--;
+        }
+        if (undoValid) {
+            // Restore the state saved before the last append, the previous block is unchanged if a new one was started
+            if (block.count > 0) {
+                block.length = undoLength;
+            }
+            memcpy(lastValues, undoValues, valueCount * sizeof(int32_t));
+            lastStamp = undoStamp;
+            undoValid = false;
+        } else if (usedBlocks > 0) {
+            // Decode the remaining samples of the newest block to get its length and the newest sample
+            Block& newest = blocks[tail()];
+            uint16_t pos = 0;
+            lastStamp = newest.microsStamp;
+            memset(lastValues, 0, valueCount * sizeof(int32_t));
+            for (uint16_t i = 0; i < newest.count; i++) {
+                decode(blockBytes(tail()), pos, lastStamp, lastValues);
+            }
+            newest.length = pos;
+        }
+    }
+
+    uint16_t getSize() { return size; }
+
+    // Estimate from the current compression ratio, or from one byte per value if empty
+    uint16_t getMaxSize() {
+        uint32_t usedBytes = 0;
+        for (uint16_t i = 0; i < usedBlocks; i++) {
+            usedBytes += blocks[(head + i) % blockCount].length;
+        }
+        uint32_t maxSize = (size > 0) ? (uint32_t)size * blockSize * blockCount / usedBytes : (uint32_t)blockSize * blockCount / (1 + valueCount);
+        return min(maxSize, (uint32_t)UINT16_MAX);
+    }
+
+    const char* getTypeName() { return "compressed"; }
+
+    uint64_t getMicrosStamp(uint16_t index) {
+        if (index == size - 1) {
+            return lastStamp;
+        }
+        seek(index);
+        return cursorStamp;
+    }
+
+    int32_t* getValues(uint16_t index) {
+        if (index == size - 1) {
+            return lastValues;
+        }
+        seek(index);
+        return cursorValues;
+    }
+
+    uint16_t findIndexAfter(uint64_t microsStamp) {
+        // Skip whole blocks using the time stamp of their first sample, then decode within the block
+        uint16_t index = 0;
+        uint16_t block = 0;
+        while ((block + 1 < usedBlocks) && (blocks[(head + block + 1) % blockCount].microsStamp <= microsStamp)) {
+            index += blocks[(head + block) % blockCount].count;
+            block++;
+        }
+        while ((index < size) && (getMicrosStamp(index) <= microsStamp)) {
+            index++;
+        }
+        return index;
+    }
+
+    void openBlock(uint64_t microsStamp) {
+        // Remove the oldest block if all are used, the indices shift
+        if (usedBlocks == blockCount) {
+            size -= blocks[head].count;
+            head = (head + 1) % blockCount;
+            usedBlocks--;
+            cursorValid = false;
+        }
+        usedBlocks++;
+        blocks[tail()] = { microsStamp, 0, 0 };
+        // Decoding of a block starts from zero
+        lastStamp = microsStamp;
+        memset(lastValues, 0, valueCount * sizeof(int32_t));
+    }
+
+    void seek(uint16_t index) {
+        // Restart at the beginning of the block containing the index, unless moving forward within the cursor block
+        if (!cursorValid || (index < cursorIndex) || (index >= cursorBlockFirst + blocks[cursorBlock].count)) {
+            cursorBlock = head;
+            cursorBlockFirst = 0;
+            while (index >= cursorBlockFirst + blocks[cursorBlock].count) {
+                cursorBlockFirst += blocks[cursorBlock].count;
+                cursorBlock = (cursorBlock + 1) % blockCount;
+            }
+            cursorPos = 0;
+            cursorStamp = blocks[cursorBlock].microsStamp;
+            memset(cursorValues, 0, valueCount * sizeof(int32_t));
+            decode(blockBytes(cursorBlock), cursorPos, cursorStamp, cursorValues);
+            cursorIndex = cursorBlockFirst;
+            cursorValid = true;
+        }
+        while (cursorIndex < index) {
+            decode(blockBytes(cursorBlock), cursorPos, cursorStamp, cursorValues);
+            cursorIndex++;
+        }
+    }
+
+    uint16_t encode(uint64_t microsStamp, int32_t* newValues) {
+        uint16_t pos = writeVarint(encoded, microsStamp - lastStamp);
+        for (uint8_t i = 0; i < valueCount; i++) {
+            // Wrapping 32-bit difference is exact and fits into 5 bytes
+            int32_t delta = (uint32_t)newValues[i] - (uint32_t)lastValues[i];
+            pos += writeVarint(encoded + pos, ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31));
+        }
+        return pos;
+    }
+
+    void decode(uint8_t* block, uint16_t& pos, uint64_t& microsStamp, int32_t* values) {
+        microsStamp += readVarint(block, pos);
+        for (uint8_t i = 0; i < valueCount; i++) {
+            uint32_t zigzag = readVarint(block, pos);
+            values[i] = (uint32_t)values[i] + ((zigzag >> 1) ^ -(zigzag & 1));
+        }
+    }
+
+    static uint8_t writeVarint(uint8_t* buffer, uint64_t value) {
+        uint8_t length = 0;
+        while (value >= 0x80) {
+            buffer[length++] = (value & 0x7F) | 0x80;
+            value >>= 7;
+        }
+        buffer[length++] = value;
+        return length;
+    }
+
+    static uint64_t readVarint(uint8_t* buffer, uint16_t& pos) {
+        uint64_t value = 0;
+        uint8_t shift = 0;
+        while (buffer[pos] & 0x80) {
+            value |= (uint64_t)(buffer[pos++] & 0x7F) << shift;
+            shift += 7;
+        }
+        return value | ((uint64_t)buffer[pos++] << shift);
+    }
+};
+
+#endif
@@ -0,0 +1,116 @@
+/*
+Copyright Production 3000
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef XMODULESENSOR_DATACOLLECTION_DATATIER
+#define XMODULESENSOR_DATACOLLECTION_DATATIER
+
+#include <Arduino.h>
+
+#include "XmoduleSensor_DataCollection_DataStore.h"
+#include "XmoduleSensor_DataProcessing.h"
+
+
+/**
+ * Downsampled history of fixed intervals, round-robin archive of mean, minimum, and maximum per value.
+ *
+ * Samples are consolidated incrementally, an interval is stored as soon as the first sample of the next interval arrives.
+ * Intervals are aligned to multiples of the interval length, the time stamp is the middle of the interval.
+ */
+struct DataTier {
+
+    uint32_t interval_ms;
+    uint8_t valueCount;
+    DataStore* dataStore; // Per row the means, then the minima, then the maxima of all values
+
+    // Current interval
+    int64_t* sum;
+    int32_t* row; // Minima and maxima are updated in place, means are set when the interval is finished
+    uint64_t interval = 0; // Number of the interval since boot
+    uint32_t count = 0;
+
+    int32_t* processed; // Row with processing applied, valid until the next call
+
+    DataTier(uint32_t interval_ms, uint8_t valueCount, DataStore* dataStore) : interval_ms(interval_ms), valueCount(valueCount), dataStore(dataStore) {
+        sum = new int64_t[valueCount];
+        row = new int32_t[3 * valueCount];
+        processed = new int32_t[3 * valueCount];
+    }
+
+    ~DataTier() {
+        delete dataStore;
+        delete[] sum;
+        delete[] row;
+        delete[] processed;
+    }
+
+    void add(uint64_t microsStamp, int32_t* values) {
+        uint64_t sampleInterval = microsStamp / ((uint64_t)interval_ms * 1000);
+        if ((count > 0) && (sampleInterval != interval)) {
+            finish();
+        }
+
+        if (count == 0) {
+            interval = sampleInterval;
+            for (uint8_t i = 0; i < valueCount; i++) {
+                sum[i] = 0;
+                row[valueCount + i] = values[i];
+                row[2 * valueCount + i] = values[i];
+            }
+        }
+
+        for (uint8_t i = 0; i < valueCount; i++) {
+            sum[i] += values[i];
+            row[valueCount + i] = min(row[valueCount + i], values[i]);
+            row[2 * valueCount + i] = max(row[2 * valueCount + i], values[i]);
+        }
+        count++;
+    }
+
+    void finish() {
+        // Mean rounded half away from zero
+        for (uint8_t i = 0; i < valueCount; i++) {
+            row[i] = (sum[i] + ((sum[i] >= 0) ? (int64_t)count / 2 : - (int64_t)count / 2)) / count;
+        }
+        dataStore->append((interval * interval_ms + interval_ms / 2) * 1000, row);
+        count = 0;
+    }
+
+    void clear() {
+        dataStore->clear();
+        count = 0;
+    }
+
+    /**
+     * Get the row at the given index with offset, scaling, and tare applied.
+     */
+    int32_t* getProcessedValues(uint16_t index, DataProcessing& processing) {
+        int32_t* values = dataStore->getValues(index);
+        for (uint8_t i = 0; i < valueCount; i++) {
+            processed[i] = processing.applyProcessing(values[i], i);
+            processed[valueCount + i] = processing.applyProcessing(values[valueCount + i], i);
+            processed[2 * valueCount + i] = processing.applyProcessing(values[2 * valueCount + i], i);
+            // Negative scaling turns the minimum into the maximum
+            if (processed[valueCount + i] > processed[2 * valueCount + i]) {
+                int32_t swap = processed[valueCount + i];
+                processed[valueCount + i] = processed[2 * valueCount + i];
+                processed[2 * valueCount + i] = swap;
+            }
+        }
+        return processed;
+    }
+};
+
+#endif
@@ -0,0 +1,114 @@
+/*
+Copyright Production 3000
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef XMODULESENSOR_DATACOLLECTION_DEADBAND
+#define XMODULESENSOR_DATACOLLECTION_DEADBAND
+
+#include <Arduino.h>
+
+
+/**
+ * Deadband of each value around its last reported value. A measurement is reported if a value leaves its band, or if
+ * the heartbeat interval since the last report passed.
+ *
+ * The reference is the last reported value, not the previous measurement, so a slow drift is reported once it adds up
+ * to the band. A band is absolute in integer units, relative in permille of the reference, or both, leaving either is
+ * enough. Integer arithmetic only.
+ */
+struct DataDeadband {
+
+    struct Band {
+        uint32_t absolute; // Integer units, 0 to disable
+        uint16_t relativePermille; // 0 to disable
+        boolean custom; // Set for this value, otherwise the default band applies
+    };
+
+    uint8_t valueCount;
+    Band* bands;
+    int32_t* references; // Last reported values
+    uint64_t referenceMicros = 0;
+    uint16_t referenceRevision = 0; // Processing revision of the references, other units if it changed
+    boolean primed = false;
+
+    DataDeadband(uint8_t valueCount) : valueCount(valueCount) {
+        bands = new Band[valueCount];
+        references = new int32_t[valueCount];
+        for (uint8_t i = 0; i < valueCount; i++) {
+            bands[i] = { 0, 0, false };
+        }
+    }
+
+    ~DataDeadband() {
+        delete[] bands;
+        delete[] references;
+    }
+
+    DataDeadband(const DataDeadband&) = delete;
+    DataDeadband& operator=(const DataDeadband&) = delete;
+
+    boolean setBand(uint8_t valueIndex, uint32_t absolute, uint16_t relativePermille) {
+        if (valueIndex >= valueCount) {
+            return false;
+        }
+        bands[valueIndex] = { absolute, relativePermille, true };
+        return true;
+    }
+
+    Band getBand(uint8_t valueIndex, const Band& defaultBand) { return (bands[valueIndex].custom) ? bands[valueIndex] : defaultBand; }
+
+    /** At least one value has a band, with none all measurements are reported. */
+    boolean isActive(const Band& defaultBand) {
+        for (uint8_t i = 0; i < valueCount; i++) {
+            Band band = getBand(i, defaultBand);
+            if ((band.absolute > 0) || (band.relativePermille > 0)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /** The value left its band. A value without band never does. */
+    boolean isOutside(uint8_t valueIndex, int32_t value, const Band& defaultBand) {
+        Band band = getBand(valueIndex, defaultBand);
+        int64_t reference = references[valueIndex];
+        int64_t delta = abs((int64_t)value - reference);
+        if ((band.absolute > 0) && (delta > band.absolute)) {
+            return true;
+        }
+        // delta / |reference| > permille / 1000 without division
+        if ((band.relativePermille > 0) && (delta * 1000 > (int64_t)band.relativePermille * abs(reference))) {
+            return true;
+        }
+        return false;
+    }
+
+    /** No reference yet, the references are in other units, or the heartbeat is due. */
+    boolean isDue(uint64_t microsStamp, uint16_t revision, uint32_t heartbeat_ms) {
+        if (!primed || (revision != referenceRevision)) {
+            return true;
+        }
+        return (heartbeat_ms > 0) && (microsStamp - referenceMicros >= (uint64_t)heartbeat_ms * 1000);
+    }
+
+    void setReference(const int32_t* values, uint64_t microsStamp, uint16_t revision) {
+        memcpy(references, values, valueCount * sizeof(int32_t));
+        referenceMicros = microsStamp;
+        referenceRevision = revision;
+        primed = true;
+    }
+};
+
+#endif
@@ -0,0 +1,239 @@
+/*
+Copyright Production 3000
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef XMODULESENSOR_DATACOLLECTION_EVENTCAPTURE
+#define XMODULESENSOR_DATACOLLECTION_EVENTCAPTURE
+
+#include <Arduino.h>
+
+
+/**
+ * Oscilloscope-like capture of events in the raw samples, before filtering and averaging.
+ *
+ * A ring keeps the latest pre-trigger samples. Once a trigger fires, the post-trigger samples are added and the event is
+ * ready as a whole: pre-trigger samples, the trigger sample, and post-trigger samples. New samples are ignored until the
+ * event is kept and the capture re-armed.
+ *
+ * The kept event is a second ring, swapped with the capture ring when the event is kept. It is read for downloads while
+ * the next event is captured.
+ */
+struct EventCapture {
+
+    enum TriggerMode: uint8_t {
+        RISING = 0, // Value crosses the threshold upwards
+        FALLING = 1, // Value crosses the threshold downwards
+        SLOPE = 2, // Change to the previous sample is at least the threshold, both directions
+        DEVIATION = 3, // Deviation from the rolling mean is at least the threshold, both directions
+    };
+
+    struct Trigger {
+        uint8_t valueIndex;
+        TriggerMode mode;
+        int32_t threshold;
+    };
+
+    enum State: uint8_t {
+        ARMED = 0,
+        CAPTURING = 1,
+        READY = 2,
+    };
+
+    static const uint8_t triggerCountMax = 4;
+    static const uint8_t meanShift = 6; // Rolling mean over about 64 samples
+    static const uint8_t meanFractionBits = 8;
+
+    uint8_t valueCount;
+    uint16_t preCount;
+    uint16_t postCount;
+
+    Trigger triggers[triggerCountMax];
+    uint8_t triggerCount = 0;
+
+    // Ring of preCount + 1 + postCount samples
+    uint16_t capacity;
+    int32_t* values;
+    uint64_t* stamps;
+    uint16_t head = 0; // Oldest sample
+    uint16_t size = 0;
+
+    // Latest kept event, same layout as the capture ring
+    int32_t* keptValues;
+    uint64_t* keptStamps;
+    uint16_t keptHead = 0;
+    uint16_t keptSize = 0;
+    uint16_t keptTriggerPos = 0;
+    uint8_t keptTriggerIndex = 0;
+    uint32_t keptNumber = 0; // Event count when kept, 0 if none yet
+
+    // Trigger state per value
+    int32_t* previous;
+    int64_t* means; // Fixed point with meanFractionBits
+    boolean primed = false;
+
+    State state = State::ARMED;
+    uint16_t postRemaining = 0;
+    uint16_t triggerPos = 0; // Position of the trigger sample counted from head, valid when ready
+    uint8_t triggerIndex = 0; // Index of the trigger that fired
+    uint32_t eventCount = 0;
+
+    // Counts as checked by isValid()
+    EventCapture(uint8_t valueCount, uint16_t preCount, uint16_t postCount) : valueCount(valueCount), preCount(preCount), postCount(postCount) {
+        capacity = preCount + 1 + postCount;
+        values = new int32_t[capacity * valueCount];
+        stamps = new uint64_t[capacity];
+        keptValues = new int32_t[capacity * valueCount];
+        keptStamps = new uint64_t[capacity];
+        previous = new int32_t[valueCount];
+        means = new int64_t[valueCount];
+    }
+
+    ~EventCapture() {
+        delete[] values;
+        delete[] stamps;
+        delete[] keptValues;
+        delete[] keptStamps;
+        delete[] previous;
+        delete[] means;
+    }
+
+    /** The ring of pre-trigger, trigger, and post-trigger samples is counted with 16 bits. */
+    static boolean isValid(uint8_t valueCount, uint16_t preCount, uint16_t postCount) {
+        return (valueCount > 0) && ((uint32_t)preCount + 1 + postCount <= UINT16_MAX);
+    }
+
+    /** Heap taken by capture ring, kept ring, and the trigger state. */
+    static uint32_t getMemoryBytes(uint8_t valueCount, uint16_t preCount, uint16_t postCount) {
+        return 2 * ((uint32_t)preCount + 1 + postCount) * (valueCount * sizeof(int32_t) + sizeof(uint64_t)) + valueCount * (sizeof(int32_t) + sizeof(int64_t));
+    }
+
+    boolean addTrigger(uint8_t valueIndex, TriggerMode mode, int32_t threshold) {
+        if ((triggerCount >= triggerCountMax) || (valueIndex >= valueCount)) {
+            return false;
+        }
+        triggers[triggerCount++] = { valueIndex, mode, threshold };
+        return true;
+    }
+
+    void add(uint64_t microsStamp, int32_t* newValues) {
+        if (state == State::READY) {
+            return;
+        }
+
+        // Store, the oldest is dropped if full
+        uint16_t slot = (head + size) % capacity;
+        if (size == capacity) {
+            head = (head + 1) % capacity;
+        } else {
+            size++;
+        }
+        memcpy(&values[slot * valueCount], newValues, valueCount * sizeof(int32_t));
+        stamps[slot] = microsStamp;
+
+        if (state == State::ARMED) {
+            if (checkTriggers(newValues)) {
+                // Drop samples beyond the pre-trigger count, the ring then fits the post-trigger samples
+                if (size > preCount + 1) {
+                    head = (head + size - preCount - 1) % capacity;
+                    size = preCount + 1;
+                }
+                triggerPos = size - 1;
+                state = State::CAPTURING;
+                postRemaining = postCount;
+            }
+        } else if (postRemaining > 0) {
+            postRemaining--;
+        }
+        if ((state == State::CAPTURING) && (postRemaining == 0)) {
+            state = State::READY;
+            eventCount++;
+        }
+        updateTriggerState(newValues);
+    }
+
+    boolean checkTriggers(int32_t* newValues) {
+        if (!primed) {
+            return false;
+        }
+        for (uint8_t t = 0; t < triggerCount; t++) {
+            Trigger& trigger = triggers[t];
+            int64_t value = newValues[trigger.valueIndex];
+            boolean fired = false;
+            switch (trigger.mode) {
+                case TriggerMode::RISING:
+                    fired = (previous[trigger.valueIndex] < trigger.threshold) && (value >= trigger.threshold);
+                    break;
+                case TriggerMode::FALLING:
+                    fired = (previous[trigger.valueIndex] > trigger.threshold) && (value <= trigger.threshold);
+                    break;
+                case TriggerMode::SLOPE:
+                    fired = abs(value - previous[trigger.valueIndex]) >= trigger.threshold;
+                    break;
+                case TriggerMode::DEVIATION:
+                    fired = abs(value * (1 << meanFractionBits) - means[trigger.valueIndex]) >= (int64_t)trigger.threshold * (1 << meanFractionBits);
+                    break;
+            }
+            if (fired) {
+                triggerIndex = t;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void updateTriggerState(int32_t* newValues) {
+        for (uint8_t i = 0; i < valueCount; i++) {
+            int64_t value = (int64_t)newValues[i] * (1 << meanFractionBits);
+            means[i] = (primed) ? means[i] + ((value - means[i]) >> meanShift) : value;
+            previous[i] = newValues[i];
+        }
+        primed = true;
+    }
+
+    /**
+     * Start capturing the next event, the pre-trigger samples are collected anew.
+     */
+    void rearm() {
+        head = 0;
+        size = 0;
+        primed = false;
+        state = State::ARMED;
+    }
+
+    /**
+     * Keep the ready event and start capturing the next one. The rings are swapped, nothing is copied.
+     */
+    void keep() {
+        int32_t* swapValues = keptValues;
+        keptValues = values;
+        values = swapValues;
+        uint64_t* swapStamps = keptStamps;
+        keptStamps = stamps;
+        stamps = swapStamps;
+        keptHead = head;
+        keptSize = size;
+        keptTriggerPos = triggerPos;
+        keptTriggerIndex = triggerIndex;
+        keptNumber = eventCount;
+        rearm();
+    }
+
+    boolean isReady() { return state == State::READY; }
+
+    int32_t* getKeptValues(uint16_t pos) { return &keptValues[((keptHead + pos) % capacity) * valueCount]; }
+    uint64_t getKeptMicrosStamp(uint16_t pos) { return keptStamps[(keptHead + pos) % capacity]; }
+};
+
+#endif
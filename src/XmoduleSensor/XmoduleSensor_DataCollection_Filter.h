@@ -0,0 +1,291 @@
+/*
+Copyright Production 3000
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef XMODULESENSOR_DATACOLLECTION_FILTER
+#define XMODULESENSOR_DATACOLLECTION_FILTER
+
+#include <Arduino.h>
+
+
+/**
+ * Filter stage applied to every raw sample before averaging, one instance holds the state of all values.
+ *
+ * Integer and fixed-point arithmetic only, all state is allocated on creation.
+ */
+struct DataFilter {
+
+    uint8_t valueCount;
+
+    DataFilter(uint8_t valueCount) : valueCount(valueCount) { }
+
+    virtual ~DataFilter() { }
+
+    /**
+     * Filter the values of a sample in place.
+     *
+     * @return False if the sample is dropped, as by decimation.
+     */
+    virtual boolean apply(int32_t* values) = 0;
+
+    virtual void reset() = 0;
+
+    virtual String getDescription() = 0;
+
+    /** Round a fixed-point value with the given fractional bits to integer, half up. */
+    static int32_t roundFixed(int64_t value, uint8_t fractionBits) {
+        return (value + ((int64_t)1 << (fractionBits - 1))) >> fractionBits;
+    }
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Exponential moving average with smoothing factor 1/2^shift.
+ */
+struct DataFilterEma : public DataFilter {
+
+    static const uint8_t fractionBits = 16;
+
+    uint8_t shift;
+    int64_t* state; // Fixed point with fractionBits
+    boolean initialized = false;
+
+    DataFilterEma(uint8_t valueCount, uint8_t shift) : DataFilter(valueCount), shift(constrain(shift, 1, 15)) {
+        state = new int64_t[valueCount];
+    }
+
+    ~DataFilterEma() {
+        delete[] state;
+    }
+
+    boolean apply(int32_t* values) override {
+        for (uint8_t i = 0; i < valueCount; i++) {
+            int64_t value = (int64_t)values[i] * ((int64_t)1 << fractionBits);
+            if (!initialized) {
+                state[i] = value;
+            } else {
+                state[i] += (value - state[i] + ((int64_t)1 << (shift - 1))) >> shift;
+            }
+            values[i] = roundFixed(state[i], fractionBits);
+        }
+        initialized = true;
+        return true;
+    }
+
+    void reset() override { initialized = false; }
+
+    String getDescription() override { return "EMA 1/" + String(1 << shift); }
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Moving median to reject spikes. Each value keeps its window sorted, a new sample replaces the oldest in O(window).
+ */
+struct DataFilterMedian : public DataFilter {
+
+    uint8_t window;
+    int32_t* history; // Per value the ring of the window in arrival order
+    int32_t* sorted; // Per value the window sorted
+    uint8_t head = 0; // Oldest sample in the rings
+    uint8_t size = 0;
+
+    DataFilterMedian(uint8_t valueCount, uint8_t window) : DataFilter(valueCount), window(max(window, (uint8_t)1)) {
+        history = new int32_t[valueCount * this->window];
+        sorted = new int32_t[valueCount * this->window];
+    }
+
+    ~DataFilterMedian() {
+        delete[] history;
+        delete[] sorted;
+    }
+
+    boolean apply(int32_t* values) override {
+        boolean full = (size == window);
+        for (uint8_t i = 0; i < valueCount; i++) {
+            int32_t* ring = &history[i * window];
+            int32_t* list = &sorted[i * window];
+            uint8_t count = size;
+            if (full) {
+                // Remove the oldest from the sorted list
+                uint8_t pos = 0;
+                while (list[pos] != ring[head]) {
+                    pos++;
+                }
+                memmove(&list[pos], &list[pos + 1], (count - pos - 1) * sizeof(int32_t));
+                count--;
+            }
+            // Insert the new value
+            uint8_t pos = count;
+            while ((pos > 0) && (list[pos - 1] > values[i])) {
+                list[pos] = list[pos - 1];
+                pos--;
+            }
+            list[pos] = values[i];
+            count++;
+            ring[(head + size) % window] = values[i];
+            // Median, mean of the middle two for even counts
+            values[i] = (count % 2 == 1) ? list[count / 2] : (int32_t)(((int64_t)list[count / 2 - 1] + list[count / 2]) / 2);
+        }
+        if (full) {
+            head = (head + 1) % window;
+        } else {
+            size++;
+        }
+        return true;
+    }
+
+    void reset() override {
+        head = 0;
+        size = 0;
+    }
+
+    String getDescription() override { return "median " + String(window); }
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Cascaded integrator-comb decimator, a moving sum of length factor applied order times and keeping every
+ * factor-th sample. Needs no multiplication, the gain factor^order is removed when a sample is output.
+ *
+ * Integrators wrap around, this is exact in two's complement as long as the output fits.
+ */
+struct DataFilterCic : public DataFilter {
+
+    uint16_t factor;
+    uint8_t order;
+    uint64_t gain;
+    uint64_t* integrators; // Per value order integrators
+    uint64_t* combs; // Per value order delayed comb inputs
+    uint16_t counter = 0;
+
+    DataFilterCic(uint8_t valueCount, uint16_t factor, uint8_t order) : DataFilter(valueCount), factor(max(factor, (uint16_t)1)), order(constrain(order, 1, 4)) {
+        gain = 1;
+        for (uint8_t k = 0; k < this->order; k++) {
+            gain *= this->factor;
+        }
+        integrators = new uint64_t[valueCount * this->order];
+        combs = new uint64_t[valueCount * this->order];
+        reset();
+    }
+
+    ~DataFilterCic() {
+        delete[] integrators;
+        delete[] combs;
+    }
+
+    boolean apply(int32_t* values) override {
+        for (uint8_t i = 0; i < valueCount; i++) {
+            uint64_t* integrator = &integrators[i * order];
+            integrator[0] += (int64_t)values[i];
+            for (uint8_t k = 1; k < order; k++) {
+                integrator[k] += integrator[k - 1];
+            }
+        }
+        if (++counter < factor) {
+            return false;
+        }
+        counter = 0;
+
+        for (uint8_t i = 0; i < valueCount; i++) {
+            uint64_t* comb = &combs[i * order];
+            uint64_t value = integrators[i * order + order - 1];
+            for (uint8_t k = 0; k < order; k++) {
+                uint64_t delayed = comb[k];
+                comb[k] = value;
+                value -= delayed;
+            }
+            // Remove the gain, rounded half away from zero
+            int64_t sum = (int64_t)value;
+            values[i] = (sum + ((sum >= 0) ? (int64_t)(gain / 2) : -(int64_t)(gain / 2))) / (int64_t)gain;
+        }
+        return true;
+    }
+
+    void reset() override {
+        memset(integrators, 0, valueCount * order * sizeof(uint64_t));
+        memset(combs, 0, valueCount * order * sizeof(uint64_t));
+        counter = 0;
+    }
+
+    String getDescription() override { return "CIC " + String(factor) + "x" + String(order); }
+
+    /** The output must fit into 64 bit with the gain, sample values use up to 32 bit. */
+    static boolean isValid(uint16_t factor, uint8_t order) {
+        uint64_t gain = 1;
+        for (uint8_t k = 0; k < order; k++) {
+            gain *= factor;
+        }
+        return (factor > 0) && (order > 0) && (order <= 4) && (gain <= ((uint64_t)1 << 31));
+    }
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * One-dimensional Kalman filter of a constant with random walk. Process and measurement noise are variances in squared
+ * units of the integer values. Estimate and error variance are kept in fixed point, the gain in 16 bit.
+ */
+struct DataFilterKalman : public DataFilter {
+
+    static const uint8_t fractionBits = 8;
+
+    uint32_t processNoise;
+    uint32_t measurementNoise;
+    int64_t* estimates; // Fixed point with fractionBits
+    uint64_t* errors; // Fixed point with fractionBits
+    boolean initialized = false;
+
+    DataFilterKalman(uint8_t valueCount, uint32_t processNoise, uint32_t measurementNoise) : DataFilter(valueCount), processNoise(processNoise), measurementNoise(max(measurementNoise, (uint32_t)1)) {
+        estimates = new int64_t[valueCount];
+        errors = new uint64_t[valueCount];
+    }
+
+    ~DataFilterKalman() {
+        delete[] estimates;
+        delete[] errors;
+    }
+
+    boolean apply(int32_t* values) override {
+        for (uint8_t i = 0; i < valueCount; i++) {
+            int64_t value = (int64_t)values[i] * ((int64_t)1 << fractionBits);
+            if (!initialized) {
+                estimates[i] = value;
+                errors[i] = (uint64_t)measurementNoise << fractionBits;
+                continue;
+            }
+            // Predict, then update with gain in 16 bit
+            errors[i] += (uint64_t)processNoise << fractionBits;
+            uint64_t gain = (errors[i] << 16) / (errors[i] + ((uint64_t)measurementNoise << fractionBits));
+            estimates[i] += ((value - estimates[i]) * (int64_t)gain) >> 16;
+            errors[i] = (errors[i] * (65536 - gain)) >> 16;
+            values[i] = roundFixed(estimates[i], fractionBits);
+        }
+        initialized = true;
+        return true;
+    }
+
+    void reset() override { initialized = false; }
+
+    String getDescription() override { return "Kalman " + String(processNoise) + "/" + String(measurementNoise); }
+};
+
+#endif
@@ -0,0 +1,241 @@
+/*
+Copyright Production 3000
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef XMODULESENSOR_DATACOLLECTION_MATRIXVIEW
+#define XMODULESENSOR_DATACOLLECTION_MATRIXVIEW
+
+#include <Arduino.h>
+
+#include "_Helper.h"
+extern _Helper _helper;
+
+
+/**
+ * Reduced output of a matrix sensor for a single output target: the frame is cropped to a region, binned, and encoded
+ * as matrix, as row and column means, or as the pixels changed since the last output.
+ *
+ * Binning averages blocks of binning x binning pixels, blocks at the edge of the region average the pixels they have.
+ * All buffers are allocated on creation, encoding is a single pass over the region.
+ */
+struct MatrixView {
+
+    enum Encoding: uint8_t {
+        MATRIX = 0, // All binned pixels, rows end with ';'
+        PROJECTION = 1, // Mean of each row, then mean of each column, each group ends with ';'
+        DIFFERENCE = 2, // Changed binned pixels as index:value, a full matrix as key frame
+    };
+
+    struct Settings {
+        Encoding encoding = Encoding::MATRIX;
+        uint8_t binning = 1;
+        int32_t changeThreshold = 0; // Pixels changing more are sent by DIFFERENCE
+        uint16_t keyframeInterval = 100; // Outputs between key frames of DIFFERENCE, 0 for key frames on request only
+        uint8_t firstRow = 0;
+        uint8_t firstColumn = 0;
+        uint8_t rowCount = 0; // 0 for all from the first row on
+        uint8_t columnCount = 0; // 0 for all from the first column on
+    };
+
+    static const uint8_t binningMax = 8;
+
+    Settings settings;
+    uint8_t matrixColumnCount; // Row length of the frame
+
+    // Region in pixels of the frame
+    uint8_t regionRowCount;
+    uint8_t regionColumnCount;
+
+    // Binned region
+    uint8_t rowCount;
+    uint8_t columnCount;
+    uint16_t pixelCount;
+
+    int64_t* sums; // Per binned pixel
+    int32_t* values; // Binned pixels, or row and then column means
+    int32_t* sent; // Binned pixels as last sent by DIFFERENCE
+    uint16_t outputsSinceKeyframe = 0;
+    boolean keyframeDue = true;
+
+    char* line; // Encoded output, zero-terminated
+    uint16_t lineTimeLength = 0; // Length of time stamp and separator, the line without time starts there
+
+    MatrixView(uint8_t valueCount, uint8_t matrixColumnCount, const Settings& settings) : settings(settings), matrixColumnCount(min(matrixColumnCount, valueCount)) {
+        regionRowCount = (settings.rowCount > 0) ? settings.rowCount : valueCount / this->matrixColumnCount - settings.firstRow;
+        regionColumnCount = (settings.columnCount > 0) ? settings.columnCount : this->matrixColumnCount - settings.firstColumn;
+        rowCount = (regionRowCount + settings.binning - 1) / settings.binning;
+        columnCount = (regionColumnCount + settings.binning - 1) / settings.binning;
+        pixelCount = rowCount * columnCount;
+        uint16_t valuesLength = max(pixelCount, (uint16_t)(rowCount + columnCount));
+        sums = new int64_t[pixelCount];
+        values = new int32_t[valuesLength];
+        sent = (settings.encoding == Encoding::DIFFERENCE) ? new int32_t[pixelCount] : nullptr;
+        // Time stamp and separator, per value index, sign, 10 digits, and separators, termination
+        line = new char[21 + 17 * valuesLength + 1];
+    }
+
+    ~MatrixView() {
+        delete[] sums;
+        delete[] values;
+        delete[] sent;
+        delete[] line;
+    }
+
+    MatrixView(const MatrixView&) = delete;
+    MatrixView& operator=(const MatrixView&) = delete;
+
+    /** The frame is a whole number of rows and the region lies within. */
+    static boolean isValid(uint8_t valueCount, uint8_t matrixColumnCount, const Settings& settings) {
+        uint8_t columns = min(matrixColumnCount, valueCount);
+        if ((columns == 0) || (valueCount % columns != 0) || (settings.binning == 0) || (settings.binning > binningMax)) {
+            return false;
+        }
+        uint8_t rows = valueCount / columns;
+        return (settings.firstRow < rows) && (settings.firstColumn < columns)
+            && (settings.firstRow + settings.rowCount <= rows) && (settings.firstColumn + settings.columnCount <= columns);
+    }
+
+    /**
+     * The next DIFFERENCE output is a full matrix, for example for a new client.
+     */
+    void requestKeyframe() { keyframeDue = true; }
+
+    /**
+     * Encode a frame into the line.
+     *
+     * @param frame The values of the frame, row after row.
+     * @param epochStamp_ms The time stamp of the frame.
+     * @return False if there is nothing to send, DIFFERENCE without changed pixels.
+     */
+    boolean encode(const int32_t* frame, int64_t epochStamp_ms) {
+        bin(frame);
+        uint16_t pos = _helper.printInt(line, epochStamp_ms);
+        line[pos++] = ',';
+        lineTimeLength = pos;
+
+        switch (settings.encoding) {
+            case Encoding::MATRIX:
+                pos = printValues(pos, values, pixelCount, columnCount);
+                break;
+
+            case Encoding::PROJECTION:
+                project();
+                pos = printValues(pos, values, rowCount, rowCount);
+                pos = printValues(pos, values + rowCount, columnCount, columnCount);
+                break;
+
+            case Encoding::DIFFERENCE:
+                if (keyframeDue || ((settings.keyframeInterval > 0) && (outputsSinceKeyframe >= settings.keyframeInterval))) {
+                    pos = printValues(pos, values, pixelCount, columnCount);
+                    memcpy(sent, values, pixelCount * sizeof(int32_t));
+                    keyframeDue = false;
+                    outputsSinceKeyframe = 0;
+                    break;
+                }
+                {
+                    // Changes are measured to the last sent value, a slow drift is sent once it adds up
+                    uint16_t start = pos;
+                    for (uint16_t i = 0; i < pixelCount; i++) {
+                        int64_t change = (int64_t)values[i] - sent[i];
+                        if (((change >= 0) ? change : -change) > settings.changeThreshold) {
+                            pos += _helper.printInt(line + pos, i);
+                            line[pos++] = ':';
+                            pos += _helper.printInt(line + pos, values[i]);
+                            line[pos++] = ',';
+                            sent[i] = values[i];
+                        }
+                    }
+                    outputsSinceKeyframe++;
+                    if (pos == start) {
+                        return false;
+                    }
+                    line[pos - 1] = ';';
+                }
+                break;
+        }
+        line[pos] = '\0';
+        return true;
+    }
+
+    /** Crop and bin the frame into values, sums are kept for the projection. */
+    void bin(const int32_t* frame) {
+        memset(sums, 0, pixelCount * sizeof(int64_t));
+        for (uint8_t r = 0; r < regionRowCount; r++) {
+            const int32_t* source = &frame[(settings.firstRow + r) * matrixColumnCount + settings.firstColumn];
+            int64_t* target = &sums[(r / settings.binning) * columnCount];
+            for (uint8_t c = 0; c < regionColumnCount; c++) {
+                target[c / settings.binning] += source[c];
+            }
+        }
+        for (uint8_t r = 0; r < rowCount; r++) {
+            for (uint8_t c = 0; c < columnCount; c++) {
+                values[r * columnCount + c] = divideRound(sums[r * columnCount + c], getBinRows(r) * getBinColumns(c));
+            }
+        }
+    }
+
+    /** Means of each binned row and column over all pixels of the region they cover. */
+    void project() {
+        for (uint8_t r = 0; r < rowCount; r++) {
+            int64_t sum = 0;
+            for (uint8_t c = 0; c < columnCount; c++) {
+                sum += sums[r * columnCount + c];
+            }
+            values[r] = divideRound(sum, getBinRows(r) * regionColumnCount);
+        }
+        for (uint8_t c = 0; c < columnCount; c++) {
+            int64_t sum = 0;
+            for (uint8_t r = 0; r < rowCount; r++) {
+                sum += sums[r * columnCount + c];
+            }
+            values[rowCount + c] = divideRound(sum, regionRowCount * getBinColumns(c));
+        }
+    }
+
+    uint16_t printValues(uint16_t pos, const int32_t* source, uint16_t count, uint8_t groupLength) {
+        for (uint16_t i = 0; i < count; i++) {
+            pos += _helper.printInt(line + pos, source[i]);
+            line[pos++] = ((i + 1) % groupLength == 0) ? ';' : ',';
+        }
+        return pos;
+    }
+
+    /** Pixel rows of a binned row, fewer at the edge of the region. */
+    uint8_t getBinRows(uint8_t r) { return min((uint8_t)(regionRowCount - r * settings.binning), settings.binning); }
+
+    uint8_t getBinColumns(uint8_t c) { return min((uint8_t)(regionColumnCount - c * settings.binning), settings.binning); }
+
+    String getDescription() {
+        const char* encodings[] = { "matrix", "projection", "difference" };
+        String str = String(encodings[settings.encoding]) + " " + String(rowCount) + "x" + String(columnCount);
+        if ((settings.firstRow > 0) || (settings.firstColumn > 0) || (settings.rowCount > 0) || (settings.columnCount > 0)) {
+            str += ", region " + String(settings.firstRow + 1) + "," + String(settings.firstColumn + 1) + " " + String(regionRowCount) + "x" + String(regionColumnCount);
+        }
+        if (settings.binning > 1) {
+            str += ", binning " + String(settings.binning);
+        }
+        if (settings.encoding == Encoding::DIFFERENCE) {
+            str += ", change > " + String(settings.changeThreshold);
+        }
+        return str;
+    }
+
+    /** Divide, rounded half away from zero. */
+    static int32_t divideRound(int64_t sum, uint16_t count) {
+        return (sum + ((sum >= 0) ? count / 2 : -(int64_t)(count / 2))) / count;
+    }
+};
+
+#endif
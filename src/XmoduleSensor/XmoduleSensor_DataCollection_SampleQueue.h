@@ -0,0 +1,109 @@
+/*
+Copyright Production 3000
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef XMODULESENSOR_DATACOLLECTION_SAMPLEQUEUE
+#define XMODULESENSOR_DATACOLLECTION_SAMPLEQUEUE
+
+#include <Arduino.h>
+#include <atomic>
+
+
+/**
+ * Lock-free single-producer single-consumer ring of raw samples with microsecond time stamps.
+ *
+ * The producer is an interrupt or a task on the other ESP32 core, the consumer is the loop. Each index is written by one
+ * side only, with release stores and acquire loads no lock is needed. Only loads and stores are used, no read-modify-write,
+ * as those are not lock-free on the ESP8266. If the ring is full the new sample is dropped and counted.
+ */
+struct SampleQueue {
+
+    uint8_t valueCount;
+    uint32_t capacity; // Power of two, free-running indices wrap together with the slots
+    int32_t* values;
+    uint32_t* stamps_us;
+
+    std::atomic<uint32_t> head; // Next slot to read, written by the consumer
+    std::atomic<uint32_t> tail; // Next slot to write, written by the producer
+    std::atomic<uint32_t> overflowCount; // Dropped samples, written by the producer
+
+    SampleQueue(uint8_t valueCount, uint16_t length) : valueCount(valueCount), head(0), tail(0), overflowCount(0) {
+        capacity = 1;
+        while (capacity < length) {
+            capacity <<= 1;
+        }
+        values = new int32_t[capacity * valueCount];
+        stamps_us = new uint32_t[capacity];
+    }
+
+    ~SampleQueue() {
+        delete[] values;
+        delete[] stamps_us;
+    }
+
+    SampleQueue(const SampleQueue&) = delete;
+    SampleQueue& operator=(const SampleQueue&) = delete;
+
+    /**
+     * Add a sample, producer side only. Safe to call from an interrupt.
+     *
+     * @return False if the queue is full and the sample was dropped.
+     */
+    IRAM_ATTR boolean push(const int32_t* sample, uint32_t stamp_us) {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) >= capacity) {
+            overflowCount.store(overflowCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return false;
+        }
+        uint32_t slot = t & (capacity - 1);
+        // No memcpy, it is not guaranteed to be in IRAM
+        for (uint8_t i = 0; i < valueCount; i++) {
+            values[slot * valueCount + i] = sample[i];
+        }
+        stamps_us[slot] = stamp_us;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Get the oldest sample without removing it, consumer side only. Valid until release().
+     *
+     * @return Pointer to the values, nullptr if the queue is empty.
+     */
+    int32_t* peek(uint32_t& stamp_us) {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        uint32_t slot = h & (capacity - 1);
+        stamp_us = stamps_us[slot];
+        return &values[slot * valueCount];
+    }
+
+    /**
+     * Remove the oldest sample after peek(), consumer side only.
+     */
+    void release() {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    uint32_t getSize() {
+        // Head first, it never passes the tail read afterwards
+        uint32_t h = head.load(std::memory_order_acquire);
+        return tail.load(std::memory_order_acquire) - h;
+    }
+};
+
+#endif
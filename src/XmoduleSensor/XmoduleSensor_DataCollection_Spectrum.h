@@ -0,0 +1,341 @@
+/*
+Copyright Production 3000
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef XMODULESENSOR_DATACOLLECTION_SPECTRUM
+#define XMODULESENSOR_DATACOLLECTION_SPECTRUM
+
+#include <Arduino.h>
+
+
+/**
+ * Spectrum of a single value over a block of raw samples, for vibration and noise sensors.
+ *
+ * A block of N samples is collected, N a power of two. The mean is removed, a Hann window applied, and the block
+ * transformed with a fixed-point radix-2 real FFT: the N real samples are packed as N/2 complex samples into the block
+ * itself and split into the real spectrum afterwards. Values are kept below 2^14 with a common exponent per stage, so
+ * products of samples and Q15 twiddles fit into 32 bit. All buffers are allocated on creation.
+ *
+ * The result is the RMS of the signal in equal-width bands up to half the sample rate, and the frequency of the
+ * strongest bin refined by parabolic interpolation. The next block starts interval_ms after the start of the previous.
+ */
+struct DataSpectrum {
+
+    enum State: uint8_t {
+        WAITING = 0, // For the start of the next block
+        COLLECTING = 1,
+        READY = 2, // Block complete, to be computed
+    };
+
+    static const uint16_t blockSizeMin = 16;
+    static const uint16_t blockSizeMax = 1024;
+    static const uint8_t bandCountMax = 16;
+    static const uint8_t dataBits = 14; // Values stay below 2^14 before each stage
+
+    uint8_t valueIndex;
+    uint16_t blockSize;
+    uint8_t bandCount;
+    uint32_t interval_ms;
+
+    int32_t* block; // Samples, then interleaved real and imaginary parts of N/2 complex values
+    int16_t* cosines; // Q15 cos(2 pi k / N) for k from 0 to N/2, window and twiddles
+    float_t windowMean;
+    float_t windowPower; // Mean of the squared window
+
+    State state = State::WAITING;
+    uint16_t size = 0;
+    uint64_t firstMicros = 0; // Stamp of the first sample of the block
+    uint64_t lastMicros = 0;
+    uint64_t nextMicros = 0; // Earliest start of the next block
+
+    // Result of the latest block
+    float_t* bandRms;
+    float_t sampleRate = 0; // [Hz] from the time stamps of the block
+    float_t peakFrequency = 0; // [Hz]
+    float_t peakAmplitude = 0; // Amplitude of a sine at the peak bin, without correction of the scalloping loss
+    int32_t mean = 0;
+    uint64_t resultMicros = 0; // Stamp of the middle of the block
+    uint32_t count = 0;
+
+    // Fixed-point state of the transform, the true value is the stored one times 2^exponent
+    int8_t exponent = 0;
+
+    DataSpectrum(uint8_t valueIndex, uint16_t blockSize, uint8_t bandCount, uint32_t interval_ms) : valueIndex(valueIndex), blockSize(blockSize), bandCount(bandCount), interval_ms(interval_ms) {
+        block = new int32_t[blockSize];
+        cosines = new int16_t[blockSize / 2 + 1];
+        bandRms = new float_t[bandCount];
+        for (uint16_t k = 0; k <= blockSize / 2; k++) {
+            cosines[k] = lround(32767.0 * cos(2.0 * M_PI * k / blockSize));
+        }
+        // Of the quantized window
+        double_t sum = 0;
+        double_t sumSquares = 0;
+        for (uint16_t n = 0; n < blockSize; n++) {
+            double_t w = getWindow(n) / 32768.0;
+            sum += w;
+            sumSquares += w * w;
+        }
+        windowMean = sum / blockSize;
+        windowPower = sumSquares / blockSize;
+    }
+
+    ~DataSpectrum() {
+        delete[] block;
+        delete[] cosines;
+        delete[] bandRms;
+    }
+
+    DataSpectrum(const DataSpectrum&) = delete;
+    DataSpectrum& operator=(const DataSpectrum&) = delete;
+
+    /** Block size is a power of two from 16 to 1024, at most 16 bands and not more than bins. */
+    static boolean isValid(uint16_t blockSize, uint8_t bandCount) {
+        return (blockSize >= blockSizeMin) && (blockSize <= blockSizeMax) && ((blockSize & (blockSize - 1)) == 0)
+            && (bandCount > 0) && (bandCount <= bandCountMax) && (bandCount <= blockSize / 2);
+    }
+
+    void add(uint64_t microsStamp, int32_t value) {
+        if (state == State::WAITING) {
+            if (microsStamp < nextMicros) {
+                return;
+            }
+            state = State::COLLECTING;
+            size = 0;
+            firstMicros = microsStamp;
+            nextMicros = microsStamp + (uint64_t)interval_ms * 1000;
+        }
+        if (state != State::COLLECTING) {
+            return;
+        }
+        block[size++] = value;
+        lastMicros = microsStamp;
+        if (size == blockSize) {
+            state = State::READY;
+        }
+    }
+
+    boolean isReady() { return state == State::READY; }
+
+    /**
+     * Transform the complete block into the result and wait for the next block. About N log2(N) multiplications.
+     */
+    void compute() {
+        sampleRate = (lastMicros > firstMicros) ? (blockSize - 1) * 1000000.0 / (lastMicros - firstMicros) : 0;
+        resultMicros = firstMicros + (lastMicros - firstMicros) / 2;
+        for (uint8_t b = 0; b < bandCount; b++) {
+            bandRms[b] = 0;
+        }
+        peakFrequency = 0;
+        peakAmplitude = 0;
+
+        if (prepare()) {
+            transform();
+            evaluate();
+        }
+        count++;
+        state = State::WAITING;
+    }
+
+    /**
+     * Remove the mean, bring the samples to just below 2^14 with the exponent, and apply the window.
+     *
+     * @return False if the block is constant, the spectrum is zero then.
+     */
+    boolean prepare() {
+        uint8_t bits = 0;
+        while ((1 << bits) < blockSize) {
+            bits++;
+        }
+        int64_t sum = 0;
+        for (uint16_t n = 0; n < blockSize; n++) {
+            sum += block[n];
+        }
+        mean = shiftRound(sum, bits);
+        // Deviations from the mean times N are exact in integer, also the fraction of the mean is removed
+        uint64_t maxAbs = 0;
+        for (uint16_t n = 0; n < blockSize; n++) {
+            int64_t deviation = (int64_t)block[n] * blockSize - sum;
+            maxAbs = max(maxAbs, (uint64_t)((deviation >= 0) ? deviation : -deviation));
+        }
+        if (maxAbs == 0) {
+            return false;
+        }
+        // Shift right for large values, left for small ones to keep the precision
+        uint8_t highestBit = 0;
+        while ((maxAbs >> highestBit) > 1) {
+            highestBit++;
+        }
+        exponent = max(highestBit - bits - (dataBits - 1), -16);
+        int8_t shift = bits + exponent;
+        for (uint16_t n = 0; n < blockSize; n++) {
+            int64_t value = (int64_t)block[n] * blockSize - sum;
+            value = (shift >= 0) ? shiftRound(value, shift) : value * (1 << -shift);
+            block[n] = shiftRound(value * getWindow(n), 15);
+        }
+        return true;
+    }
+
+    /**
+     * Complex FFT of the N/2 interleaved values in place, decimation in time.
+     */
+    void transform() {
+        uint16_t m = blockSize / 2;
+        // Bit-reversed order
+        for (uint16_t i = 1, j = 0; i < m; i++) {
+            uint16_t bit = m >> 1;
+            for (; j & bit; bit >>= 1) {
+                j ^= bit;
+            }
+            j ^= bit;
+            if (i < j) {
+                int32_t re = block[2 * i];
+                int32_t im = block[2 * i + 1];
+                block[2 * i] = block[2 * j];
+                block[2 * i + 1] = block[2 * j + 1];
+                block[2 * j] = re;
+                block[2 * j + 1] = im;
+            }
+        }
+
+        uint8_t shift = 0; // Input of the first stage is below 2^14
+        for (uint16_t span = 2; span <= m; span <<= 1) {
+            uint16_t half = span / 2;
+            uint16_t step = blockSize / span;
+            uint32_t maxAbs = 0;
+            for (uint16_t j = 0; j < half; j++) {
+                int32_t wr = getCos(j * step);
+                int32_t wi = -getSin(j * step);
+                for (uint16_t a = j; a < m; a += span) {
+                    int32_t* x = &block[2 * a];
+                    int32_t* y = &block[2 * (a + half)];
+                    // Products below 2^29, 32 bit is enough
+                    int32_t yr = shiftRound32(y[0], shift);
+                    int32_t yi = shiftRound32(y[1], shift);
+                    int32_t tr = shiftRound32(yr * wr - yi * wi, 15);
+                    int32_t ti = shiftRound32(yr * wi + yi * wr, 15);
+                    int32_t xr = shiftRound32(x[0], shift);
+                    int32_t xi = shiftRound32(x[1], shift);
+                    x[0] = xr + tr;
+                    x[1] = xi + ti;
+                    y[0] = xr - tr;
+                    y[1] = xi - ti;
+                    maxAbs = max(maxAbs, (uint32_t)max(max(abs(x[0]), abs(x[1])), max(abs(y[0]), abs(y[1]))));
+                }
+            }
+            exponent += shift;
+            // Bring the next stage below 2^14 again, it grows at most by 1 + sqrt(2)
+            shift = 0;
+            while ((maxAbs >> shift) >= (1 << dataBits)) {
+                shift++;
+            }
+        }
+    }
+
+    /**
+     * Twice the bin k of the real spectrum from the complex spectrum Z of the packed values,
+     * 2 X[k] = Z[k] + conj(Z[m - k]) - i W^k (Z[k] - conj(Z[m - k])), then its squared magnitude.
+     */
+    uint64_t getPower(uint16_t k) {
+        uint16_t m = blockSize / 2;
+        int64_t zr = block[2 * (k % m)];
+        int64_t zi = block[2 * (k % m) + 1];
+        int64_t cr = block[2 * ((m - k) % m)];
+        int64_t ci = -block[2 * ((m - k) % m) + 1];
+        int64_t er = zr + cr;
+        int64_t ei = zi + ci;
+        // -i (Z - conj) rotated by W^k = cos - i sin
+        int64_t dr = zi - ci;
+        int64_t di = cr - zr;
+        int64_t wr = getCos(k);
+        int64_t wi = -getSin(k);
+        int64_t xr = er + shiftRound(dr * wr - di * wi, 15);
+        int64_t xi = ei + shiftRound(dr * wi + di * wr, 15);
+        return xr * xr + xi * xi;
+    }
+
+    /**
+     * Band RMS and peak from the spectrum. The window and the one-sided spectrum are compensated, the bands together
+     * give the RMS of the signal without its mean.
+     */
+    void evaluate() {
+        uint16_t m = blockSize / 2;
+        // Power of twice the bin, scaled to the signal: |X|^2 = P / 4 * 2^(2 exponent)
+        double_t scale = ldexp(1.0, 2 * exponent) / 4 / ((double_t)blockSize * blockSize * windowPower);
+        uint64_t peakPower = 0;
+        uint16_t peakBin = 1;
+        uint64_t bandSum = 0;
+        uint8_t band = 0;
+        for (uint16_t k = 1; k <= m; k++) {
+            uint64_t power = getPower(k);
+            if (power > peakPower) {
+                peakPower = power;
+                peakBin = k;
+            }
+            // Bins of equal width, the one at half the sample rate belongs to the last band
+            uint8_t b = min((uint32_t)k * bandCount / m, (uint32_t)bandCount - 1);
+            if (b != band) {
+                bandRms[band] = sqrt(2.0 * bandSum * scale);
+                bandSum = 0;
+                band = b;
+            }
+            // Except at half the sample rate each bin has a mirror bin of the same power
+            bandSum += (k < m) ? power : power / 2;
+        }
+        bandRms[band] = sqrt(2.0 * bandSum * scale);
+
+        // Parabola through the logarithms of the peak and its neighbours, exact for a Gaussian
+        double_t offset = 0;
+        if (peakBin < m) {
+            double_t left = log(max(getPower(peakBin - 1), (uint64_t)1));
+            double_t center = log(max(peakPower, (uint64_t)1));
+            double_t right = log(max(getPower(peakBin + 1), (uint64_t)1));
+            double_t curvature = left - 2 * center + right;
+            if (curvature < 0) {
+                offset = constrain(0.5 * (left - right) / curvature, -0.5, 0.5);
+            }
+        }
+        peakFrequency = (peakBin + offset) * sampleRate / blockSize;
+        // A sine of amplitude A gives |X| = A / 2 times the window sum
+        peakAmplitude = sqrt(peakPower * ldexp(1.0, 2 * exponent) / 4) * 2 / (blockSize * windowMean);
+        if (peakBin == m) {
+            peakAmplitude /= 2;
+        }
+    }
+
+    /** Width of a band [Hz]. */
+    float_t getBandWidth() { return sampleRate / 2 / bandCount; }
+
+    /** Q15 periodic Hann window, 0.5 - 0.5 cos(2 pi n / N). */
+    int32_t getWindow(uint16_t n) {
+        return (32767 - cosines[(n <= blockSize / 2) ? n : blockSize - n] + 1) / 2;
+    }
+
+    /** Q15 cos(2 pi k / N) for k up to N/2. */
+    int32_t getCos(uint16_t k) { return cosines[k]; }
+
+    /** Q15 sin(2 pi k / N) for k up to N/2, sin(x) = cos(pi/2 - x). */
+    int32_t getSin(uint16_t k) { return cosines[abs((int32_t)blockSize / 4 - k)]; }
+
+    /** Shift right, rounded half up. */
+    static int64_t shiftRound(int64_t value, uint8_t shift) {
+        return (shift == 0) ? value : (value + ((int64_t)1 << (shift - 1))) >> shift;
+    }
+
+    static int32_t shiftRound32(int32_t value, uint8_t shift) {
+        return (shift == 0) ? value : (value + (1 << (shift - 1))) >> shift;
+    }
+};
+
+#endif
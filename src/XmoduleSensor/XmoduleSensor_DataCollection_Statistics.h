@@ -0,0 +1,245 @@
+/*
+Copyright Production 3000
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef XMODULESENSOR_DATACOLLECTION_STATISTICS
+#define XMODULESENSOR_DATACOLLECTION_STATISTICS
+
+#include <Arduino.h>
+#include <algorithm>
+#include <limits>
+
+
+/**
+ * Minimum or maximum of the last window samples, as monotonic deque in a ring buffer. O(1) amortized per sample.
+ */
+struct WindowExtremum {
+
+    int32_t* values = nullptr;
+    uint32_t* sequences = nullptr; // Sample number, to remove entries leaving the window
+    uint16_t capacity;
+    uint16_t head = 0;
+    uint16_t size = 0;
+    boolean isMax;
+
+    void init(uint16_t window, boolean _isMax) {
+        capacity = window;
+        isMax = _isMax;
+        values = new int32_t[capacity];
+        sequences = new uint32_t[capacity];
+    }
+
+    ~WindowExtremum() {
+        delete[] values;
+        delete[] sequences;
+    }
+
+    void add(uint32_t sequence, int32_t value) {
+        // Remove the oldest if it left the window, the deque then has room for the new value
+        if ((size > 0) && (sequence - sequences[head] >= capacity)) {
+            head = (head + 1) % capacity;
+            size--;
+        }
+        // Remove newer entries that can no longer become the extremum
+        while ((size > 0) && ((isMax) ? values[(head + size - 1) % capacity] <= value : values[(head + size - 1) % capacity] >= value)) {
+            size--;
+        }
+        uint16_t slot = (head + size) % capacity;
+        values[slot] = value;
+        sequences[slot] = sequence;
+        size++;
+    }
+
+    void clear() { size = 0; }
+
+    int32_t get() { return values[head]; }
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Approximate quantile in fixed memory, P² algorithm by Jain and Chlamtac. O(1) per sample.
+ *
+ * Five markers track the minimum, the quantile, the maximum and two intermediate quantiles. Marker heights are
+ * adjusted with a piecewise-parabolic prediction.
+ */
+struct P2Quantile {
+
+    float_t p;
+    float_t heights[5];
+    int32_t positions[5];
+    double_t desired[5];
+    double_t increments[5];
+    uint32_t count = 0;
+
+    void init(float_t _p) {
+        p = _p;
+        count = 0;
+        increments[0] = 0;
+        increments[1] = p / 2;
+        increments[2] = p;
+        increments[3] = (1 + p) / 2;
+        increments[4] = 1;
+    }
+
+    void add(float_t value) {
+        // Collect the first five values as initial markers
+        if (count < 5) {
+            heights[count++] = value;
+            if (count == 5) {
+                std::sort(heights, heights + 5);
+                for (uint8_t i = 0; i < 5; i++) {
+                    positions[i] = i;
+                    desired[i] = 4 * increments[i];
+                }
+            }
+            return;
+        }
+        count++;
+
+        // Cell of the value, extremes are updated
+        uint8_t k;
+        if (value < heights[0]) {
+            heights[0] = value;
+            k = 0;
+        } else if (value >= heights[4]) {
+            heights[4] = value;
+            k = 3;
+        } else {
+            k = 0;
+            while (value >= heights[k + 1]) {
+                k++;
+            }
+        }
+        for (uint8_t i = k + 1; i < 5; i++) {
+            positions[i]++;
+        }
+        for (uint8_t i = 0; i < 5; i++) {
+            desired[i] += increments[i];
+        }
+
+        // Move the middle markers towards their desired positions
+        for (uint8_t i = 1; i < 4; i++) {
+            double_t d = desired[i] - positions[i];
+            if (((d >= 1) && (positions[i + 1] - positions[i] > 1)) || ((d <= -1) && (positions[i - 1] - positions[i] < -1))) {
+                int8_t s = (d > 0) ? 1 : -1;
+                float_t height = parabolic(i, s);
+                if ((heights[i - 1] < height) && (height < heights[i + 1])) {
+                    heights[i] = height;
+                } else {
+                    heights[i] = heights[i] + s * (heights[i + s] - heights[i]) / (positions[i + s] - positions[i]);
+                }
+                positions[i] += s;
+            }
+        }
+    }
+
+    float_t parabolic(uint8_t i, int8_t s) {
+        return heights[i] + (float_t)s / (positions[i + 1] - positions[i - 1]) * (
+            (positions[i] - positions[i - 1] + s) * (heights[i + 1] - heights[i]) / (positions[i + 1] - positions[i]) +
+            (positions[i + 1] - positions[i] - s) * (heights[i] - heights[i - 1]) / (positions[i] - positions[i - 1]) );
+    }
+
+    float_t get() {
+        if (count >= 5) {
+            return heights[2];
+        }
+        // Exact for the first values
+        float_t sorted[5];
+        memcpy(sorted, heights, count * sizeof(float_t));
+        std::sort(sorted, sorted + count);
+        return sorted[(uint8_t)nearbyintf(p * (count - 1))];
+    }
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Online statistics of each value: mean and variance by Welford's algorithm, all-time and windowed minimum and maximum,
+ * and approximate quantiles.
+ */
+struct DataStatistics {
+
+    static const uint8_t quantileCount = 3;
+    const float_t quantileP[quantileCount] = { 0.05, 0.5, 0.95 };
+
+    struct Channel {
+        double_t mean = 0;
+        double_t m2 = 0; // Sum of squared differences from the mean
+        int32_t min;
+        int32_t max;
+        WindowExtremum windowMin;
+        WindowExtremum windowMax;
+        P2Quantile quantiles[quantileCount];
+    };
+
+    uint8_t valueCount;
+    uint16_t window;
+    uint32_t count = 0;
+    Channel* channels;
+
+    DataStatistics(uint8_t valueCount, uint16_t window) : valueCount(valueCount), window(max(window, (uint16_t)1)) {
+        channels = new Channel[valueCount];
+        for (uint8_t i = 0; i < valueCount; i++) {
+            channels[i].windowMin.init(this->window, false);
+            channels[i].windowMax.init(this->window, true);
+        }
+        clear();
+    }
+
+    ~DataStatistics() {
+        delete[] channels;
+    }
+
+    void add(int32_t* values) {
+        count++;
+        for (uint8_t i = 0; i < valueCount; i++) {
+            Channel& channel = channels[i];
+            double_t delta = values[i] - channel.mean;
+            channel.mean += delta / count;
+            channel.m2 += delta * (values[i] - channel.mean);
+            channel.min = min(channel.min, values[i]);
+            channel.max = max(channel.max, values[i]);
+            channel.windowMin.add(count, values[i]);
+            channel.windowMax.add(count, values[i]);
+            for (uint8_t q = 0; q < quantileCount; q++) {
+                channel.quantiles[q].add(values[i]);
+            }
+        }
+    }
+
+    void clear() {
+        count = 0;
+        for (uint8_t i = 0; i < valueCount; i++) {
+            Channel& channel = channels[i];
+            channel.mean = 0;
+            channel.m2 = 0;
+            channel.min = std::numeric_limits<int32_t>::max();
+            channel.max = std::numeric_limits<int32_t>::min();
+            channel.windowMin.clear();
+            channel.windowMax.clear();
+            for (uint8_t q = 0; q < quantileCount; q++) {
+                channel.quantiles[q].init(quantileP[q]);
+            }
+        }
+    }
+
+    // Sample standard deviation
+    double_t getStdDev(uint8_t i) { return (count > 1) ? sqrt(channels[i].m2 / (count - 1)) : 0; }
+};
+
+#endif
@@ -0,0 +1,306 @@
+/*
+Copyright Production 3000
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef XMODULESENSOR_DATACOLLECTION_VIRTUALCHANNEL
+#define XMODULESENSOR_DATACOLLECTION_VIRTUALCHANNEL
+
+#include <Arduino.h>
+
+
+/**
+ * Value computed from the other values of a sample, like a sum, a difference, or a dew point.
+ *
+ * The expression is compiled once into a compact stack bytecode, evaluation needs no parsing and no allocation. Usual
+ * precedence, parentheses, and:
+ *   v1 ... vN  values of the sample after the sample-to-int exponent, numbered from 1 as on the web page
+ *   1.5        constants
+ *   + - * / ^  arithmetic, ^ is the power
+ *   abs(x) sqrt(x) log(x) exp(x) min(x, y) max(x, y)
+ */
+struct VirtualChannel {
+
+    enum OpCode: uint8_t {
+        CONSTANT = 0, // Followed by the constant index
+        VALUE = 1, // Followed by the value index
+        ADD = 2,
+        SUBTRACT = 3,
+        MULTIPLY = 4,
+        DIVIDE = 5,
+        POWER = 6,
+        NEGATE = 7,
+        ABS = 8,
+        SQRT = 9,
+        LOG = 10,
+        EXP = 11,
+        MIN = 12,
+        MAX = 13,
+    };
+
+    static const uint8_t codeLengthMax = 64;
+    static const uint8_t constantCountMax = 16;
+    static const uint8_t stackDepthMax = 8;
+    static const uint8_t nestingMax = 8; // Parentheses and function arguments, limits the recursion of the compiler
+    static constexpr uint8_t operandCounts[OpCode::MAX + 1] = { 0, 0, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 2, 2 }; // Stack entries taken by each op code
+
+    uint8_t code[codeLengthMax];
+    uint8_t codeLength = 0;
+    float_t constants[constantCountMax];
+    uint8_t constantCount = 0;
+    uint8_t valueLimit = 0;
+
+    /**
+     * Compile the expression, an empty expression evaluates to zero.
+     *
+     * @param expression The expression.
+     * @param valueLimit The number of values that can be referenced, those before this channel.
+     * @return False if the expression is invalid or too long, the channel is unusable then.
+     */
+    boolean compile(const char* expression, uint8_t valueLimit) {
+        Compiler compiler = { this, expression, valueLimit };
+        this->valueLimit = valueLimit;
+        codeLength = 0;
+        constantCount = 0;
+        compiler.skipSpaces();
+        if (*compiler.cursor == '\0') {
+            return true;
+        }
+        compiler.parseSum();
+        compiler.skipSpaces();
+        if (compiler.error || (*compiler.cursor != '\0')) {
+            codeLength = 0;
+            constantCount = 0;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Evaluate the compiled expression.
+     *
+     * Compiled code keeps within the stack and the arrays. This is checked anyway, code that would leave them gives NaN
+     * instead of writing outside the stack.
+     *
+     * @param values The values of the sample.
+     * @param stack Preallocated stack of at least stackDepthMax.
+     */
+    float_t evaluate(const int32_t* values, float_t* stack) {
+        if (codeLength == 0) {
+            return 0;
+        }
+        uint8_t top = 0; // Number of stack entries
+        for (uint8_t pc = 0; pc < codeLength; pc++) {
+            uint8_t op = code[pc];
+            if (op <= OpCode::VALUE) {
+                // Push of a constant or value by its index
+                if ((top >= stackDepthMax) || (pc + 1 >= codeLength) || (code[pc + 1] >= ((op == OpCode::CONSTANT) ? constantCount : valueLimit))) {
+                    return NAN;
+                }
+            } else if ((op > OpCode::MAX) || (top < operandCounts[op])) {
+                return NAN;
+            }
+            switch (op) {
+                case OpCode::CONSTANT: stack[top++] = constants[code[++pc]]; break;
+                case OpCode::VALUE: stack[top++] = values[code[++pc]]; break;
+                case OpCode::ADD: top--; stack[top - 1] += stack[top]; break;
+                case OpCode::SUBTRACT: top--; stack[top - 1] -= stack[top]; break;
+                case OpCode::MULTIPLY: top--; stack[top - 1] *= stack[top]; break;
+                case OpCode::DIVIDE: top--; stack[top - 1] /= stack[top]; break;
+                case OpCode::POWER: top--; stack[top - 1] = powf(stack[top - 1], stack[top]); break;
+                case OpCode::NEGATE: stack[top - 1] = -stack[top - 1]; break;
+                case OpCode::ABS: stack[top - 1] = fabsf(stack[top - 1]); break;
+                case OpCode::SQRT: stack[top - 1] = sqrtf(stack[top - 1]); break;
+                case OpCode::LOG: stack[top - 1] = logf(stack[top - 1]); break;
+                case OpCode::EXP: stack[top - 1] = expf(stack[top - 1]); break;
+                case OpCode::MIN: top--; stack[top - 1] = fminf(stack[top - 1], stack[top]); break;
+                case OpCode::MAX: top--; stack[top - 1] = fmaxf(stack[top - 1], stack[top]); break;
+            }
+        }
+        return (top == 1) ? stack[0] : NAN;
+    }
+
+
+//////////////////////////////////////////////////////////////////////////////////
+
+    /**
+     * Recursive descent parser emitting the bytecode in postfix order, tracks the stack depth.
+     */
+    struct Compiler {
+        VirtualChannel* channel;
+        const char* cursor;
+        uint8_t valueLimit;
+        uint8_t depth = 0;
+        uint8_t nesting = 0;
+        boolean error = false;
+
+        static boolean isNumberChar(char c) { return (c >= '0') && (c <= '9'); }
+        static boolean isLetter(char c) { return (c >= 'a') && (c <= 'z'); }
+
+        void skipSpaces() {
+            while (*cursor == ' ') {
+                cursor++;
+            }
+        }
+
+        boolean accept(char c) {
+            skipSpaces();
+            if (*cursor != c) {
+                return false;
+            }
+            cursor++;
+            return true;
+        }
+
+        void emit(uint8_t op, int8_t stackChange) {
+            if (channel->codeLength >= codeLengthMax) {
+                error = true;
+                return;
+            }
+            channel->code[channel->codeLength++] = op;
+            depth += stackChange;
+            error |= (depth > stackDepthMax);
+        }
+
+        void emitPush(uint8_t op, uint8_t index) {
+            emit(op, 1);
+            emit(index, 0);
+        }
+
+        // sum := product (('+' | '-') product)*
+        void parseSum() {
+            if (++nesting > nestingMax) {
+                error = true;
+                return;
+            }
+            parseProduct();
+            while (!error) {
+                if (accept('+')) {
+                    parseProduct();
+                    emit(OpCode::ADD, -1);
+                } else if (accept('-')) {
+                    parseProduct();
+                    emit(OpCode::SUBTRACT, -1);
+                } else {
+                    break;
+                }
+            }
+            nesting--;
+        }
+
+        // product := unary (('*' | '/') unary)*
+        void parseProduct() {
+            parseUnary();
+            while (!error) {
+                if (accept('*')) {
+                    parseUnary();
+                    emit(OpCode::MULTIPLY, -1);
+                } else if (accept('/')) {
+                    parseUnary();
+                    emit(OpCode::DIVIDE, -1);
+                } else {
+                    return;
+                }
+            }
+        }
+
+        // unary := '-'* power
+        void parseUnary() {
+            // A loop, not recursion, a long run of signs must not exhaust the stack
+            boolean negate = false;
+            while (accept('-')) {
+                negate = !negate;
+            }
+            parsePower();
+            if (negate) {
+                emit(OpCode::NEGATE, 0);
+            }
+        }
+
+        // power := primary ('^' unary)?, right-associative
+        void parsePower() {
+            parsePrimary();
+            if (!error && accept('^')) {
+                parseUnary();
+                emit(OpCode::POWER, -1);
+            }
+        }
+
+        // primary := number | value | function '(' sum (',' sum)? ')' | '(' sum ')'
+        void parsePrimary() {
+            skipSpaces();
+            if (error) {
+                return;
+            }
+            if (isNumberChar(*cursor) || (*cursor == '.')) {
+                char* end;
+                float_t number = strtof(cursor, &end);
+                if ((end == cursor) || (channel->constantCount >= constantCountMax)) {
+                    error = true;
+                    return;
+                }
+                cursor = end;
+                channel->constants[channel->constantCount] = number;
+                emitPush(OpCode::CONSTANT, channel->constantCount++);
+            } else if ((*cursor == 'v') && isNumberChar(cursor[1])) {
+                cursor++;
+                uint16_t number = 0;
+                while (isNumberChar(*cursor) && (number <= 255)) {
+                    number = number * 10 + (*cursor++ - '0');
+                }
+                // Numbered from 1, only values before this channel
+                if ((number == 0) || (number > valueLimit)) {
+                    error = true;
+                    return;
+                }
+                emitPush(OpCode::VALUE, number - 1);
+            } else if (isLetter(*cursor)) {
+                parseFunction();
+            } else if (accept('(')) {
+                parseSum();
+                error |= !accept(')');
+            } else {
+                error = true;
+            }
+        }
+
+        void parseFunction() {
+            struct Function { const char* name; OpCode op; uint8_t argumentCount; };
+            static const Function functions[] = {
+                { "abs", OpCode::ABS, 1 }, { "sqrt", OpCode::SQRT, 1 }, { "log", OpCode::LOG, 1 }, { "exp", OpCode::EXP, 1 },
+                { "min", OpCode::MIN, 2 }, { "max", OpCode::MAX, 2 },
+            };
+            const char* start = cursor;
+            while (isLetter(*cursor)) {
+                cursor++;
+            }
+            for (const Function& function : functions) {
+                if ((strlen(function.name) == (size_t)(cursor - start)) && (strncmp(function.name, start, cursor - start) == 0)) {
+                    error |= !accept('(');
+                    parseSum();
+                    if (function.argumentCount == 2) {
+                        error |= !accept(',');
+                        parseSum();
+                    }
+                    error |= !accept(')');
+                    emit(function.op, 1 - function.argumentCount);
+                    return;
+                }
+            }
+            error = true;
+        }
+    };
+};
+
+#endif
@@ -21,6 +21,7 @@ limitations under the License.
 #include <ArduinoJson.h>
 
 #include "Config_JsonInterface.h"
+#include "XmoduleSensor_DataProcessing_Calibration.h"
 
 
 struct DataProcessing : public JsonInterface {
@@ -28,22 +29,49 @@ struct DataProcessing : public JsonInterface {
     // Data processing for sensor values:
     // Exponent is fixed in code, offset and scaling are stored, tare is forgotten after reboot
     // { [ ( raw * pow10(exponent) ) + offset ] * scaling } + tare
+    // A calibrated value uses its table instead of the scaling: table[ ( raw * pow10(exponent) ) + offset ] + tare
 
     NumberArrayLateInit<int32_t> offset;
     NumberArrayLateInit<int8_t> sampleToIntExponent;
+    NumberArrayLateInit<float_t> sampleToIntMultiplier; // Precomputed pow10(exponent)
     NumberArrayLateInit<float_t> scaling;
     NumberArrayLateInit<int32_t> tare;
 
+    // Optional fixed-point scaling, avoids soft-float on the FPU-less ESP8266
+    // SCALING = multiplier * 2^-shift, the multiplier is normalized to 31 significant bits per value
+    boolean fixedPoint = false;
+    NumberArrayLateInit<int32_t> scalingFixedMultiplier;
+    NumberArrayLateInit<int8_t> scalingFixedShift; // -1 if the scaling cannot be represented, float is used then
+
+    // Optional non-linear calibration per value, nullptr for linear scaling
+    CalibrationTable** calibrations = nullptr;
+
     int32_t scalingTargetValue = 0;
     uint8_t scalingTargetIndex = 0;
 
+    uint16_t revision = 0; // Incremented with every change of offset, scaling, or tare to invalidate processed values
+
     DataProcessing() : JsonInterface("cfgDataProcessing") { }
 
+    ~DataProcessing() {
+        clearCalibrations();
+        delete[] calibrations;
+    }
+
     void initDataValueSize(uint8_t dataValueSize) {
+        // Tables of the previous size
+        clearCalibrations();
+        delete[] calibrations;
+        calibrations = new CalibrationTable*[dataValueSize]();
+
         sampleToIntExponent.lateInit(dataValueSize, 0);
+        sampleToIntMultiplier.lateInit(dataValueSize, 1);
         offset.lateInit(dataValueSize, 0);
         scaling.lateInit(dataValueSize, 1);
         tare.lateInit(dataValueSize, 0);
+        scalingFixedMultiplier.lateInit(dataValueSize, 0);
+        scalingFixedShift.lateInit(dataValueSize, 0);
+        updateScalingFixed();
     }
 
 
@@ -59,6 +87,33 @@ struct DataProcessing : public JsonInterface {
             JsonArray jsonArray = jsonDoc.createNestedArray("scaling");
             scaling.loopArray([&](float_t& value, uint8_t i) { jsonArray.add(value); });
         }
+        if (hasCalibration()) {
+            // One object per value, empty for linear scaling
+            JsonArray jsonArray = jsonDoc.createNestedArray("calibration");
+            offset.loopArray([&](int32_t& value, uint8_t i) {
+                JsonObject jsonObject = jsonArray.createNestedObject();
+                CalibrationTable* calibration = calibrations[i];
+                if (calibration == nullptr) {
+                    return;
+                }
+                if (calibration->degree > 0) {
+                    JsonArray jsonPolynomial = jsonObject.createNestedArray("polynomial");
+                    for (uint8_t d = 0; d <= calibration->degree; d++) {
+                        jsonPolynomial.add(calibration->coefficients[d]);
+                    }
+                    // The last knot results in the same knots as the original range
+                    jsonObject["from"] = calibration->x[0];
+                    jsonObject["to"] = calibration->x[calibration->pointCount - 1];
+                } else {
+                    JsonArray jsonX = jsonObject.createNestedArray("x");
+                    JsonArray jsonY = jsonObject.createNestedArray("y");
+                    for (uint8_t k = 0; k < calibration->pointCount; k++) {
+                        jsonX.add(calibration->x[k]);
+                        jsonY.add(calibration->y[k]);
+                    }
+                }
+            });
+        }
     }
 
     bool importFromJson(JsonDocument &jsonDoc) {
@@ -82,20 +137,75 @@ struct DataProcessing : public JsonInterface {
 
             // Assign values
             scaling.loopArray([&](float_t& value, uint8_t i) { value = jsonArray[i].as<float_t>(); });
+            updateScalingFixed();
+        }
+        if (jsonDoc.containsKey("calibration") && jsonDoc["calibration"].is<JsonArray>()) {
+            JsonArray jsonArray = jsonDoc["calibration"].as<JsonArray>();
+
+            // Make sure size is correct to not have memory issues
+            if (jsonArray.size() != offset.value_size)
+                return false;
+
+            // Assign tables, invalid ones are dropped
+            offset.loopArray([&](int32_t& value, uint8_t i) { setCalibration(i, createCalibration(jsonArray[i].as<JsonObject>())); });
         }
+        revision++;
         return true;
     }
 
+    CalibrationTable* createCalibration(JsonObject jsonObject) {
+        if (jsonObject.containsKey("polynomial") && jsonObject["polynomial"].is<JsonArray>()) {
+            JsonArray jsonPolynomial = jsonObject["polynomial"].as<JsonArray>();
+            uint8_t degree = jsonPolynomial.size() - 1;
+            int32_t from = jsonObject["from"].as<int32_t>();
+            int32_t to = jsonObject["to"].as<int32_t>();
+            if ((jsonPolynomial.size() == 0) || !CalibrationTable::isValid(degree, from, to))
+                return nullptr;
+            float_t coefficients[CalibrationTable::polynomialDegreeMax + 1];
+            for (uint8_t d = 0; d <= degree; d++) {
+                coefficients[d] = jsonPolynomial[d].as<float_t>();
+            }
+            return new CalibrationTable(coefficients, degree, from, to);
+        }
+        if (jsonObject.containsKey("x") && jsonObject["x"].is<JsonArray>() && jsonObject.containsKey("y") && jsonObject["y"].is<JsonArray>()) {
+            JsonArray jsonX = jsonObject["x"].as<JsonArray>();
+            JsonArray jsonY = jsonObject["y"].as<JsonArray>();
+            if ((jsonX.size() != jsonY.size()) || (jsonX.size() > CalibrationTable::pointCountMax))
+                return nullptr;
+            int32_t x[CalibrationTable::pointCountMax];
+            int32_t y[CalibrationTable::pointCountMax];
+            uint8_t count = jsonX.size();
+            for (uint8_t k = 0; k < count; k++) {
+                x[k] = jsonX[k].as<int32_t>();
+                y[k] = jsonY[k].as<int32_t>();
+            }
+            if (!CalibrationTable::isValid(x, count))
+                return nullptr;
+            return new CalibrationTable(x, y, count);
+        }
+        return nullptr;
+    }
+
 
 //////////////////////////////////////////////////////////////////////////////////
 
     void setOffset(int32_t* offsetMeasurement) {
         // OFFSET = -1 * RAW
         offset.loopArray([&](int32_t& value, uint8_t i) { value = - offsetMeasurement[i]; });
+        revision++;
     };
 
-    void setSampleToIntExponent(int8_t *_sampleToIntExponent) {
-        sampleToIntExponent.loopArray([&](int8_t& value, uint8_t i) { value = _sampleToIntExponent[i]; } );
+    void resetOffset() {
+        offset.resetValues();
+        revision++;
+    };
+
+    void setSampleToIntExponent(int8_t *_sampleToIntExponent, uint8_t count) {
+        // Only values coming with a sample, virtual channels are computed as integers
+        for (uint8_t i = 0; i < count; i++) {
+            sampleToIntExponent.values[i] = _sampleToIntExponent[i];
+            sampleToIntMultiplier.values[i] = pow10(_sampleToIntExponent[i]);
+        }
     };
 
     void setScaling(int32_t* scalingMeasurement) {
@@ -105,6 +215,65 @@ struct DataProcessing : public JsonInterface {
                 value = (float_t)scalingTargetValue / (scalingMeasurement[i] + offset.values[i])  ;
             }
         });
+        updateScalingFixed();
+    };
+
+    void resetScaling() {
+        scaling.resetValues();
+        updateScalingFixed();
+    };
+
+    /**
+     * Enable or disable the fixed-point pipeline. The result is within one LSB of the float pipeline.
+     */
+    void setFixedPoint(boolean enable) {
+        fixedPoint = enable;
+        updateScalingFixed();
+    };
+
+    void updateScalingFixed() {
+        revision++;
+        // Precompute integer multiplier and shift for each scaling: SCALING = mantissa * 2^exponent, 0.5 <= |mantissa| < 1
+        scaling.loopArray([&](float_t& value, uint8_t i) {
+            int exponent;
+            float_t mantissa = frexpf(value, &exponent);
+            int16_t shift = 30 - exponent;
+            if (value == 0) {
+                scalingFixedMultiplier.values[i] = 0;
+                scalingFixedShift.values[i] = 1;
+            } else if ((shift < 1) || (shift > 62)) {
+                // Product would overflow 64 bit, keep float
+                scalingFixedShift.values[i] = -1;
+            } else {
+                scalingFixedMultiplier.values[i] = lroundf(ldexpf(mantissa, 30)); // |multiplier| <= 2^30
+                scalingFixedShift.values[i] = shift;
+            }
+        });
+    };
+
+    /**
+     * Replace the calibration of a value, nullptr to return to linear scaling. The table is owned afterwards.
+     */
+    void setCalibration(uint8_t valueIndex, CalibrationTable* calibration) {
+        delete calibrations[valueIndex];
+        calibrations[valueIndex] = calibration;
+        revision++;
+    };
+
+    void clearCalibrations() {
+        for (uint8_t i = 0; (calibrations != nullptr) && (i < offset.value_size); i++) {
+            delete calibrations[i];
+            calibrations[i] = nullptr;
+        }
+        revision++;
+    };
+
+    boolean hasCalibration() {
+        for (uint8_t i = 0; i < offset.value_size; i++) {
+            if (calibrations[i] != nullptr)
+                return true;
+        }
+        return false;
     };
 
     void setScalingTarget(uint8_t valueIndex, int32_t targetValue) {
@@ -113,20 +282,32 @@ struct DataProcessing : public JsonInterface {
     };
 
     void setTare(int32_t* lastMeasurement) {
-        // TARE = -1 * ( (lastRAW - OFFSET) * SCALING )
-        tare.loopArray([&](int32_t& value, uint8_t i) { value = - ( (lastMeasurement[i] - offset.values[i]) * scaling.values[i] ); });
+        // TARE = -1 * ( (lastRAW + OFFSET) * SCALING ), the same offset as applyProcessing()
+        tare.loopArray([&](int32_t& value, uint8_t i) {
+            if (calibrations[i] != nullptr) {
+                value = - calibrations[i]->apply(addOffset(lastMeasurement[i], i));
+            } else {
+                value = - ( addOffset(lastMeasurement[i], i) * scaling.values[i] );
+            }
+        });
+        revision++;
+    };
+
+    void clearTare() {
+        tare.resetValues();
+        revision++;
     };
 
 
 //////////////////////////////////////////////////////////////////////////////////
 
     template <typename T>
-    int32_t* applySampleToIntExponent(T *newSample) {
-        int32_t* decimalShiftedSample = new int32_t[sampleToIntExponent.value_size];
-        sampleToIntExponent.loopArray([&](int8_t& value, uint8_t i) {
-            decimalShiftedSample[i] = nearbyintf( (float_t)pow10(value) * newSample[i] );
-        });
-        return decimalShiftedSample;
+    int32_t applySampleToIntExponent(T value, uint8_t i) {
+        // Exponent zero is the default, integer samples need no float conversion
+        if (sampleToIntExponent.values[i] == 0) {
+            return std::is_integral<T>::value ? (int32_t)value : (int32_t)nearbyintf(value);
+        }
+        return nearbyintf(sampleToIntMultiplier.values[i] * value);
     };
 
     void applyProcessing(NumberArrayLateInit<int32_t> &values) {
@@ -139,9 +320,24 @@ struct DataProcessing : public JsonInterface {
     int32_t applyProcessing(int32_t value, uint8_t i) {
         // Apply offset and scaling to single value
         // SCALED = (RAW + OFFSET) * SCALING + TARE
+        if (calibrations[i] != nullptr) {
+            // Table lookup instead of the scaling
+            return calibrations[i]->apply(addOffset(value, i)) + tare.values[i];
+        }
+        if (fixedPoint && (scalingFixedShift.values[i] >= 0)) {
+            // 64 bit product of 33 bit sum and 31 bit multiplier, round half up by adding 0.5 before the shift
+            int8_t shift = scalingFixedShift.values[i];
+            int64_t product = ((int64_t)value + offset.values[i]) * scalingFixedMultiplier.values[i];
+            return (int32_t)((product + ((int64_t)1 << (shift - 1))) >> shift) + tare.values[i];
+        }
         return nearbyintf( ( (value + offset.values[i]) * scaling.values[i] ) + tare.values[i] );
     };
 
+    int32_t addOffset(int32_t value, uint8_t i) {
+        // Saturate, the table clamps to its range anyway
+        return constrain((int64_t)value + offset.values[i], (int64_t)std::numeric_limits<int32_t>::min(), (int64_t)std::numeric_limits<int32_t>::max());
+    };
+
 };
 
 #endif
\ No newline at end of file
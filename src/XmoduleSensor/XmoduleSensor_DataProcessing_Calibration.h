@@ -0,0 +1,207 @@
+/*
+Copyright Production 3000
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef XMODULESENSOR_DATAPROCESSING_CALIBRATION
+#define XMODULESENSOR_DATAPROCESSING_CALIBRATION
+
+#include <Arduino.h>
+
+
+/**
+ * Non-linear calibration of a single value, a table of points with linear interpolation in between.
+ *
+ * The table is defined either by measured points, or by a polynomial up to cubic sampled at uniformly spaced knots over
+ * an input range. Slopes are precomputed in fixed point, a conversion costs a lookup, a multiplication, and a shift.
+ * Knots of a polynomial are spaced by a power of two, the segment is found by a shift instead of a binary search.
+ * Inputs outside the table are clamped to its ends.
+ */
+struct CalibrationTable {
+
+    static const uint8_t pointCountMax = 32;
+    static const uint8_t polynomialSegmentCount = 64;
+    static const uint8_t polynomialDegreeMax = 3;
+    static const uint8_t slopeFractionBitsMin = 16;
+
+    uint8_t pointCount;
+    int32_t* x; // Strictly increasing
+    int32_t* y;
+    int64_t* slopes; // Per segment, fixed point with slopeFractionBits
+    uint8_t slopeFractionBits; // Per table, see updateSlopes()
+    int8_t uniformShift = -1; // Knots are 2^shift apart, -1 if not uniform
+
+    // Definition of a polynomial, kept for export, degree 0 for a table of points
+    uint8_t degree = 0;
+    float_t coefficients[polynomialDegreeMax + 1];
+
+    /**
+     * Table of measured points.
+     */
+    CalibrationTable(const int32_t* pointsX, const int32_t* pointsY, uint8_t count) : pointCount(count) {
+        allocate();
+        memcpy(x, pointsX, pointCount * sizeof(int32_t));
+        memcpy(y, pointsY, pointCount * sizeof(int32_t));
+        updateSlopes();
+    }
+
+    /**
+     * Polynomial c0 + c1 * x + c2 * x^2 + c3 * x^3 sampled over the range from to to.
+     */
+    CalibrationTable(const float_t* polynomial, uint8_t degree, int32_t from, int32_t to) : pointCount(polynomialSegmentCount + 1), degree(degree) {
+        allocate();
+        memcpy(coefficients, polynomial, (degree + 1) * sizeof(float_t));
+        uniformShift = getPolynomialShift(from, to);
+        for (uint8_t k = 0; k < pointCount; k++) {
+            x[k] = from + ((int32_t)k << uniformShift);
+            // Horner scheme in double, only done once
+            double_t value = 0;
+            for (int8_t d = degree; d >= 0; d--) {
+                value = value * x[k] + coefficients[d];
+            }
+            y[k] = (int32_t)constrain(round(value), (double_t)std::numeric_limits<int32_t>::min(), (double_t)std::numeric_limits<int32_t>::max());
+        }
+        updateSlopes();
+    }
+
+    ~CalibrationTable() {
+        delete[] x;
+        delete[] y;
+        delete[] slopes;
+    }
+
+    CalibrationTable(const CalibrationTable&) = delete;
+    CalibrationTable& operator=(const CalibrationTable&) = delete;
+
+    void allocate() {
+        x = new int32_t[pointCount];
+        y = new int32_t[pointCount];
+        slopes = new int64_t[pointCount - 1];
+    }
+
+    /**
+     * Precompute the slopes. The fraction bits cover the longest segment, the rounding error of a slope then adds less
+     * than half a LSB over its segment and the result stays within 1 LSB. They are limited so that rise times 2^bits, and
+     * the products in apply(), stay within 62 bit. That only cuts them for segments longer than 2^30 with a large rise.
+     */
+    void updateSlopes() {
+        uint64_t runMax = 0;
+        uint64_t riseMax = 0;
+        for (uint8_t k = 0; k < pointCount - 1; k++) {
+            int64_t rise = (int64_t)y[k + 1] - y[k];
+            runMax = max(runMax, (uint64_t)((int64_t)x[k + 1] - x[k]));
+            riseMax = max(riseMax, (uint64_t)((rise >= 0) ? rise : -rise));
+        }
+        uint8_t riseBits = 0;
+        while ((riseMax >> riseBits) > 0) {
+            riseBits++;
+        }
+        slopeFractionBits = slopeFractionBitsMin;
+        while ((((uint64_t)1 << slopeFractionBits) < runMax) && (slopeFractionBits + riseBits < 62)) {
+            slopeFractionBits++;
+        }
+
+        for (uint8_t k = 0; k < pointCount - 1; k++) {
+            // Round half away from zero, truncation would bias every segment toward its start value
+            int64_t rise = ((int64_t)y[k + 1] - y[k]) * ((int64_t)1 << slopeFractionBits);
+            int64_t run = (int64_t)x[k + 1] - x[k];
+            slopes[k] = (rise + ((rise >= 0) ? run / 2 : -(run / 2))) / run;
+        }
+    }
+
+    /** Smallest knot spacing 2^shift to cover the range, it starts at from. */
+    static int8_t getPolynomialShift(int32_t from, int32_t to) {
+        int8_t shift = 0;
+        while (((int64_t)polynomialSegmentCount << shift) < (int64_t)to - from) {
+            shift++;
+        }
+        return shift;
+    }
+
+    static boolean isValid(const int32_t* pointsX, uint8_t count) {
+        if ((count < 2) || (count > pointCountMax)) {
+            return false;
+        }
+        for (uint8_t k = 1; k < count; k++) {
+            if (pointsX[k] <= pointsX[k - 1]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static boolean isValid(uint8_t degree, int32_t from, int32_t to) {
+        // The last knot must fit into 32 bit
+        return (degree >= 1) && (degree <= polynomialDegreeMax) && (from < to)
+            && ((int64_t)from + ((int64_t)polynomialSegmentCount << getPolynomialShift(from, to)) <= std::numeric_limits<int32_t>::max());
+    }
+
+
+//////////////////////////////////////////////////////////////////////////////////
+
+    int32_t apply(int32_t value) {
+        uint8_t last = pointCount - 1;
+        if (value <= x[0]) {
+            return y[0];
+        }
+        if (value >= x[last]) {
+            return y[last];
+        }
+        uint8_t k;
+        if (uniformShift >= 0) {
+            k = ((uint32_t)value - (uint32_t)x[0]) >> uniformShift;
+        } else {
+            // Binary search for the segment x[k] <= value < x[k + 1]
+            uint8_t low = 0;
+            uint8_t high = last;
+            while (high - low > 1) {
+                uint8_t middle = (low + high) / 2;
+                if (x[middle] <= value) {
+                    low = middle;
+                } else {
+                    high = middle;
+                }
+            }
+            k = low;
+        }
+        // Round half up, the step can exceed 32 bit for a full-range segment
+        return (int32_t)(y[k] + ((((int64_t)value - x[k]) * slopes[k] + ((int64_t)1 << (slopeFractionBits - 1))) >> slopeFractionBits));
+    }
+
+    /** Interpolated value for a non-integer input, as used for statistics. */
+    double_t applyFloat(double_t value) {
+        value = constrain(value, (double_t)x[0], (double_t)x[pointCount - 1]);
+        uint8_t k = getSegment(value);
+        return y[k] + (value - x[k]) * getSlope(k);
+    }
+
+    /** Slope of the segment at the given input, clamped to the end segments. */
+    double_t getSlope(double_t value) { return getSlope(getSegment(value)); }
+
+    double_t getSlope(uint8_t k) { return ((double_t)y[k + 1] - y[k]) / ((double_t)x[k + 1] - x[k]); }
+
+    uint8_t getSegment(double_t value) {
+        uint8_t k = 0;
+        while ((k < pointCount - 2) && (value >= x[k + 1])) {
+            k++;
+        }
+        return k;
+    }
+
+    boolean isDecreasing() { return y[pointCount - 1] < y[0]; }
+
+    String getDescription() { return (degree > 0) ? "degree " + String(degree) + " polynomial" : String(pointCount) + " points"; }
+};
+
+#endif
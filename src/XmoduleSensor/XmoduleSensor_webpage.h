@@ -23,16 +23,23 @@ const char htmlXmoduleSensor[] PROGMEM = R"===(%0%
 <p>%103%</p>
 <h3>Data Handling</h3>
 <ul>
+    <li>Sample queue: %109% </li>
+    <li>Filter chain before averaging: %110% </li>
+    <li>Virtual channels, expressions over the values v1, v2, ... with + - * / ^ ( ) abs sqrt log exp min max:<br>
+        %105% </li>
     <li>Averaging count sample measurements:<br>
         <form action='/save' method='post'> <input name='avgCountSample' value='%111%' type='number' min='1' max='255'> <input type='submit' value='Save'> </form> </li>
     <li>Averaging count offset/scaling measurements:<br>
         <form action='/save' method='post'> <input name='avgCountOffsetScaling' value='%112%' type='number' min='1' max='255'> <input type='submit' value='Save'> </form> </li>
     <li>Reporting minimum interval between data points, 0 to report all measurements:<br>
         <form action='/save' method='post'> <input name='reportingInterval' value='%113%' type='number' min='0' max='65535'> [ms] <input type='submit' value='Save'> </form> </li>
-    <li>Reporting minimum change threshold, 0 to report all measurements:<br>
-        <form action='/save' method='post'> <input name='thresholdPermilleChange' value='%116%' type='number' min='0' max='255'> &permil; <input type='submit' value='Save'> </form> </li>
+    <li>Reporting minimum change threshold to the last reported value, 0 to report all measurements:<br>
+        <form action='/save' method='post'> <input name='thresholdPermilleChange' value='%116%' type='number' min='0' max='255'> &permil; <input type='submit' value='Save'> </form>
+        <form action='/save' method='post'> <input name='thresholdAbsoluteChange' value='%106%' type='number' min='0' max='65535'> [int] <input type='submit' value='Save'> </form> </li>
     <li>Apply threshold only to single value, -1 to apply to all values:<br>
         <form action='/save' method='post'> <input name='thresholdOnlySingleIndex' value='%117%' type='number' min='-1' max='255'> <input type='submit' value='Save'> </form> </li>
+    <li>Reporting heartbeat, maximum interval between data points despite the threshold, 0 to disable:<br>
+        <form action='/save' method='post'> <input name='reportingHeartbeat' value='%107%' type='number' min='0' max='65535'> [s] <input type='submit' value='Save'> </form> </li>
 </ul>
 <h3>Data Interface</h3>
  <ul>
@@ -40,6 +47,12 @@ const char htmlXmoduleSensor[] PROGMEM = R"===(%0%
     <li>Current data: <a href='/sensordata'>/sensordata</a> </li>
     <li>Live websocket: ws://%2%/wssensor </li>
     <li>CSV data: <a href='/sensordatasscaled'>/sensordatasscaled</a>, <a href='/sensordatasraw'>/sensordatasraw</a> </li>
+    <li>Binary data: <a href='/sensordatasbin'>/sensordatasbin</a> </li>
+    <li>Downsampled tiers (mean, min, max): %118% </li>
+    <li>Statistics: %119% </li>
+    <li>Event capture: %108% </li>
+    <li>Spectra: %104% </li>
+    <li>Matrix output: %122% </li>
 </ul>
 <h3>Sensor Details</h3>
 <table>
@@ -49,6 +62,7 @@ const char htmlXmoduleSensor[] PROGMEM = R"===(%0%
         <td>Unit</td>
         <td>Offset</td>
         <td>Scaling</td>
+        <td>Calibration</td>
         <td>Float to Int exp. 10<sup>x</sup></td>
     </tr>
     %120%
@@ -63,11 +77,13 @@ const char htmlXmoduleSensor[] PROGMEM = R"===(%0%
             <input type='submit' value='Measure scaling'> </form>
         </td>
         <td></td>
+        <td></td>
     </tr>
     <tr>
         <td colspan='3'></td>
         <td> <form action='/start' method='post' onsubmit='return confirm(`Reset offset?`);'> <input name='resetOffset' type='hidden'> <input type='submit' value='Reset offset'> </form> </td>
         <td> <form action='/start' method='post' onsubmit='return confirm(`Reset scaling?`);'> <input name='resetScaling' type='hidden'> <input type='submit' value='Reset scaling'> </form> </td>
+        <td> <form action='/start' method='post' onsubmit='return confirm(`Reset calibration?`);'> <input name='resetCalibration' type='hidden'> <input type='submit' value='Reset calibration'> </form> </td>
         <td></td>
     </tr>
 </table>
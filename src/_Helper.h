@@ -143,6 +143,33 @@ struct _Helper {
 
 ///////////////////////////////////////////////////////////////////////////////////
 
+    /**
+     * @brief Write an integer as decimal ASCII to a char buffer, without terminating zero. Avoids String and printf overhead.
+     *
+     * @param buffer Buffer with at least 20 free characters
+     * @param value Value to write
+     * @return Number of characters written
+     */
+    uint8_t printInt(char* buffer, int64_t value) {
+        uint8_t len = 0;
+        uint64_t magnitude = value;
+        if (value < 0) {
+            buffer[len++] = '-';
+            magnitude = -magnitude; // Also correct for the minimum value
+        }
+        // Digits in reverse order into temporary buffer
+        char digits[20];
+        uint8_t count = 0;
+        do {
+            digits[count++] = '0' + (magnitude % 10);
+            magnitude /= 10;
+        } while (magnitude > 0);
+        while (count > 0) {
+            buffer[len++] = digits[--count];
+        }
+        return len;
+    }
+
     /**
      * @brief Print a formatted string
      *
@@ -27,7 +27,7 @@ extern _Helper _helper;
  * @brief A templated linked list implementation for the MVP3000 framework.
  *
  * The list has a maximum size limit set during initialization. If the limit is reached, the oldest element is automatically removed.
- * 3000 bare: append, clear, loop, getNewest, getOldest, getSize
+ * 3000 bare: append, clear, loop, getNewest, getOldest, getSize, optional node pool
  * 3001 extends bare: unique list nodes - dataStruct needs equals() method
  * 3010 extends bare: bookmark node
  * 3100 extends bare: grow list
@@ -44,6 +44,7 @@ struct LinkedList3000 {
         Node* prev; // towards head
         Node* next; // towards tail
 
+        Node() : dataStruct(nullptr) { } // Pool node, the dataStruct is assigned when the node is taken from the pool
         Node(T* newDataStruct) {
             dataStruct = newDataStruct;
         }
@@ -58,9 +59,15 @@ struct LinkedList3000 {
     T* getNewestData() { return tail->dataStruct; }
     T* getOldestData() { return head->dataStruct; }
 
-    uint16_t size;
+    uint16_t size = 0;
     uint16_t max_size;
 
+    // Optional node pool: one preallocated block of nodes, removed nodes are put on a free list instead of being deleted
+    // Removed pool nodes keep their dataStruct as spare, it can be reused with recycleDataStruct()
+    Node* nodePool = nullptr;
+    Node* nodePoolFree = nullptr; // Singly linked using next
+    uint16_t nodePoolSize = 0;
+
     uint16_t getSize() const { return size; }
     uint16_t getMaxSize() const { return max_size; }
 
@@ -77,6 +84,57 @@ struct LinkedList3000 {
 
     ~LinkedList3000() {
         clear(); // IMPORTANT: Make sure to also free memory within the dataStruct
+        delete[] nodePool; // Also deletes spare dataStructs of free pool nodes
+    }
+
+
+    /**
+     * @brief Preallocate the nodes of the list in a single block. Removed nodes are recycled instead of deleted.
+     *
+     * Appending and removing does not allocate or free nodes on the heap anymore. Together with recycleDataStruct() also the
+     * data structures can be reused, so a full list does zero heap calls in steady state. Nodes beyond the pool capacity,
+     * for example of a growing list, are allocated individually as before.
+     *
+     * @param capacity The number of nodes to preallocate, typically the maximum size of the list.
+     * @return True if the pool was created, false if the list is not empty.
+     */
+    boolean enableNodePool(uint16_t capacity) {
+        if (size > 0) {
+            return false;
+        }
+        delete[] nodePool;
+        nodePool = new Node[capacity];
+        nodePoolSize = capacity;
+        // Chain all nodes to the free list, first node on top
+        nodePoolFree = nullptr;
+        for (uint16_t i = capacity; i > 0; i--) {
+            nodePool[i - 1].next = nodePoolFree;
+            nodePoolFree = &nodePool[i - 1];
+        }
+        return true;
+    }
+
+    /**
+     * @brief Get a data structure for reuse, to be modified and passed to appendDataStruct() without allocating a new one.
+     *
+     * If the list is full the oldest node is removed and its data structure is returned. Otherwise the spare data structure
+     * of the next free pool node is returned, if there is one.
+     *
+     * @return The data structure to be reused, nullptr if there is none. In that case a new one needs to be created.
+     */
+    // Virtual to allow overwriting by derived auto-growing list
+    virtual T* recycleDataStruct() {
+        T* dataStruct = nullptr;
+        if ((head != nullptr) && (size >= max_size)) {
+            // Detach from the oldest node, the node itself is recycled by the append
+            dataStruct = head->dataStruct;
+            head->dataStruct = nullptr;
+            _removeNode(head);
+        } else if (nodePoolFree != nullptr) {
+            dataStruct = nodePoolFree->dataStruct;
+            nodePoolFree->dataStruct = nullptr;
+        }
+        return dataStruct;
     }
 
 
@@ -91,8 +149,8 @@ struct LinkedList3000 {
         if (size >= max_size) {
             _removeNode(head);
         }
-        // Append the new node
-        Node* newNode = new Node(newDataStruct);
+        // Append the new node, taken from the pool if possible
+        Node* newNode = _acquireNode(newDataStruct);
         newNode->prev = nullptr;
         newNode->next = nullptr;
         // Set head, tail, increment size
@@ -150,9 +208,34 @@ struct LinkedList3000 {
             existingNode->next->prev = existingNode->prev; // Link the next node directly to the previous node
         }
 
-        delete existingNode; // IMPORTANT: Make sure to also free memory within the dataStruct
+        _releaseNode(existingNode);
         size--;
     }
+
+    Node* _acquireNode(T* newDataStruct) {
+        if (nodePoolFree == nullptr) {
+            return new Node(newDataStruct);
+        }
+        Node* node = nodePoolFree;
+        nodePoolFree = node->next;
+        // Spare dataStruct was not recycled, but a new one is given
+        if (node->dataStruct != newDataStruct) {
+            delete node->dataStruct;
+            node->dataStruct = newDataStruct;
+        }
+        return node;
+    }
+
+    void _releaseNode(Node* node) {
+        if ((node >= nodePool) && (node < nodePool + nodePoolSize)) {
+            // Pool node, keep the dataStruct as spare for recycling
+            node->prev = nullptr;
+            node->next = nodePoolFree;
+            nodePoolFree = node;
+        } else {
+            delete node; // IMPORTANT: Make sure to also free memory within the dataStruct
+        }
+    }
 };
 
 
@@ -161,7 +244,7 @@ struct LinkedList3000 {
  * @brief A templated linked list implementation for the MVP3000 framework.
  *
  * The list has a maximum size limit set during initialization. If the limit is reached, the oldest element is automatically removed.
- * 3000 bare: append, clear, loop, getNewest, getOldest, getSize
+ * 3000 bare: append, clear, loop, getNewest, getOldest, getSize, optional node pool
  * 3001 extends bare: unique list nodes - dataStruct needs equals() method
  * 3010 extends bare: bookmark node
  * 3100 extends bare: grow list
@@ -239,7 +322,7 @@ struct LinkedList3001 : virtual LinkedList3000<T> {
  * @brief A templated linked list implementation for the MVP3000 framework.
  *
  * The list has a maximum size limit set during initialization. If the limit is reached, the oldest element is automatically removed.
- * 3000 bare: append, clear, loop, getNewest, getOldest, getSize
+ * 3000 bare: append, clear, loop, getNewest, getOldest, getSize, optional node pool
  * 3001 extends bare: unique list nodes - dataStruct needs equals() method
  * 3010 extends bare: bookmark node
  * 3100 extends bare: grow list
@@ -302,7 +385,7 @@ struct LinkedList3010 : virtual LinkedList3000<T> {
  * @brief A templated linked list implementation for the MVP3000 framework.
  *
  * The list has a maximum size limit set during initialization. If the limit is reached, the oldest element is automatically removed.
- * 3000 bare: append, clear, loop, getNewest, getOldest, getSize
+ * 3000 bare: append, clear, loop, getNewest, getOldest, getSize, optional node pool
  * 3001 extends bare: unique list nodes - dataStruct needs equals() method
  * 3010 extends bare: bookmark node
  * 3100 extends bare: grow list
@@ -356,6 +439,23 @@ struct LinkedList3100 : virtual LinkedList3000<T> {
             growMaxSize();
         LinkedList3000<T>::appendDataStruct(newDataStruct);
     }
+
+    /**
+     * @brief Get a data structure for reuse. The oldest node of a full list is only recycled if the list is not adaptive.
+     *
+     * @return The data structure to be reused, nullptr if there is none.
+     */
+    T* recycleDataStruct() {
+        if (adpative && (this->size >= this->max_size)) {
+            // Give growing a chance, only reuse a spare from the pool
+            if (this->nodePoolFree == nullptr)
+                return nullptr;
+            T* dataStruct = this->nodePoolFree->dataStruct;
+            this->nodePoolFree->dataStruct = nullptr;
+            return dataStruct;
+        }
+        return LinkedList3000<T>::recycleDataStruct();
+    }
 };
 
 
@@ -364,7 +464,7 @@ struct LinkedList3100 : virtual LinkedList3000<T> {
  * @brief A templated linked list implementation for the MVP3000 framework.
  *
  * The list has a maximum size limit set during initialization. If the limit is reached, the oldest element is automatically removed.
- * 3000 bare: append, clear, loop, getNewest, getOldest, getSize
+ * 3000 bare: append, clear, loop, getNewest, getOldest, getSize, optional node pool
  * 3001 extends bare: unique list nodes - dataStruct needs equals() method
  * 3010 extends bare: bookmark node
  * 3100 extends bare: grow list
@@ -46,7 +46,10 @@ MicroPlot3000 = new function() {
 
     $.loadData = async function() {
         try {
-            const url = `http://${location.host}/${$.urlFolder}`;
+            // Can be called periodically, only data newer than the last received is requested, the first request loads all
+            let url = `http://${location.host}/${$.urlFolder}`;
+            if ($.data.length > 0)
+                url += `${url.includes('?') ? '&' : '?'}since=${$.data[$.data.length - 1].x}`;
             const response = await fetch(url);
             if (!response.ok)
                 throw new Error(`Response status: ${response.status}`);
@@ -62,6 +65,9 @@ MicroPlot3000 = new function() {
     $.appendData = function(csvString) {
         // Remove all whitespaces, newline characters, etc.
         csvString = csvString.replace(/\s/g, '');
+        // Nothing new
+        if (csvString.length == 0)
+            return;
         // Remove the last semicolon
         csvString = csvString.slice(0, -1);
         
@@ -0,0 +1,130 @@
+"""
+Copyright Production 3000
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+"""
+
+#   Decoder for the binary data download of the sensor module /sensordatasbin
+#
+#   Usage: python decode.py <url_or_file> [--raw]
+#       Prints the data as CSV with time in milliseconds, scaled unless --raw is given
+#       Example: python decode.py http://192.168.4.1/sensordatasbin
+
+import bisect
+import struct
+import sys
+import urllib.request
+
+
+def decode(data):
+    """ Decode the binary download, returns the header as dict and the records as list of (sequence, epoch_us, values) """
+    if data[0:4] != b"MVPB":
+        raise ValueError("Not a binary sensor data download")
+    version, value_count, matrix_column_count = struct.unpack_from("<BBBx", data, 4)
+    if version not in (1, 2, 3):
+        raise ValueError(f"Unknown format version {version}")
+    # Version 1 has time stamps in milliseconds
+    stamp_to_us = 1000 if version == 1 else 1
+    pos = 8
+
+    channels = []
+    for i in range(value_count):
+        exponent, offset, scaling, tare = struct.unpack_from("<bifi", data, pos)
+        pos += 13
+        strings = []
+        for j in range(2):
+            length = data[pos]
+            strings.append(data[pos + 1:pos + 1 + length].decode('utf-8'))
+            pos += 1 + length
+        # Version 3 has the calibration points, none for linear scaling
+        calibration = None
+        if version >= 3:
+            count = data[pos]
+            pos += 1
+            if count > 0:
+                points = struct.unpack_from(f"<{2 * count}i", data, pos)
+                calibration = (points[:count], points[count:])
+                pos += 8 * count
+        channels.append({"type": strings[0], "unit": strings[1], "exponent": exponent, "offset": offset, "scaling": scaling, "tare": tare, "calibration": calibration})
+    header = {"version": version, "matrix_column_count": matrix_column_count, "channels": channels}
+
+    record = struct.Struct(f"<Iq{value_count}i")
+    records = []
+    # A download could be cut off, ignore an incomplete last record
+    while pos + record.size <= len(data):
+        sequence, epoch_stamp, *values = record.unpack_from(data, pos)
+        records.append((sequence, epoch_stamp * stamp_to_us, values))
+        pos += record.size
+
+    return header, records
+
+
+def scale(header, values):
+    """ Apply offset, scaling, and tare as the device does: SCALED = (RAW + OFFSET) * SCALING + TARE, or TABLE[RAW + OFFSET] + TARE """
+    scaled = []
+    for value, c in zip(values, header["channels"]):
+        if c["calibration"] is not None:
+            scaled.append(interpolate(c["calibration"], max(-2**31, min(value + c["offset"], 2**31 - 1))) + c["tare"])
+        else:
+            # Single precision as on the device, each operation is rounded to float
+            scaled.append(round(float32(float32(float32(value + c["offset"]) * c["scaling"]) + float32(c["tare"]))))
+    return scaled
+
+
+def float32(value):
+    """ Round to the nearest single-precision float """
+    return struct.unpack("<f", struct.pack("<f", value))[0]
+
+
+def interpolate(calibration, value):
+    """ Linear interpolation in the same fixed point as CalibrationTable::apply(), inputs outside are clamped """
+    x, y = calibration
+    if value <= x[0]:
+        return y[0]
+    if value >= x[-1]:
+        return y[-1]
+    k = bisect.bisect_right(x, value) - 1
+    # Fraction bits cover the longest segment, from 16 on, and keep rise times 2^bits within 62 bit
+    run_max = max(b - a for a, b in zip(x, x[1:]))
+    rise_bits = max(abs(b - a) for a, b in zip(y, y[1:])).bit_length()
+    bits = 16
+    while (1 << bits) < run_max and bits + rise_bits < 62:
+        bits += 1
+    # Slope rounded half away from zero, C integer division truncates
+    rise = (y[k + 1] - y[k]) << bits
+    run = x[k + 1] - x[k]
+    slope = (abs(rise) + run // 2) // run
+    if rise < 0:
+        slope = -slope
+    return y[k] + (((value - x[k]) * slope + (1 << (bits - 1))) >> bits)
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        print("Usage: python decode.py <url_or_file> [--raw]")
+        sys.exit(1)
+
+    source = sys.argv[1]
+    if source.startswith("http://"):
+        with urllib.request.urlopen(source) as response:
+            data = response.read()
+    else:
+        with open(source, 'rb') as file:
+            data = file.read()
+
+    header, records = decode(data)
+    raw = "--raw" in sys.argv
+
+    print("time," + ",".join(f'{c["type"]} [{c["unit"]}] e{c["exponent"]}' for c in header["channels"]))
+    for sequence, epoch_us, values in records:
+        print(f"{epoch_us / 1000:.3f}," + ",".join(str(v) for v in (values if raw else scale(header, values))))
@@ -0,0 +1,68 @@
+"""
+Copyright Production 3000
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+"""
+
+#   Round trip of the binary data download: decodes it and compares with the CSV downloads of the same data
+#
+#   Usage: python test_roundtrip.py <binary> <raw_csv> <scaled_csv>
+#       The files are downloads of /sensordatasbin, /sensordatasraw, and /sensordatasscaled, taken from a device or
+#       written by tools/hosttest/test_binarydownload.cpp
+#       Example: python test_roundtrip.py sensordatasbin sensordatasraw sensordatasscaled
+
+import sys
+
+from decode import decode, scale
+
+
+def read_csv(path):
+    """ Rows as list of (epoch_ms, values), a row ends with ';' also between the rows of a matrix """
+    with open(path) as file:
+        text = file.read()
+    rows = []
+    for line in text.split("\n"):
+        fields = line.replace(";", ",").strip(",").split(",")
+        if len(fields) > 1:
+            rows.append((int(fields[0]), [int(v) for v in fields[1:]]))
+    return rows
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 4:
+        print("Usage: python test_roundtrip.py <binary> <raw_csv> <scaled_csv>")
+        sys.exit(1)
+
+    with open(sys.argv[1], 'rb') as file:
+        header, records = decode(file.read())
+    raw = read_csv(sys.argv[2])
+    scaled = read_csv(sys.argv[3])
+
+    failures = []
+    if not (len(records) == len(raw) == len(scaled)) or len(records) == 0:
+        failures.append(f"record count binary {len(records)}, raw {len(raw)}, scaled {len(scaled)}")
+    for k, ((sequence, epoch_us, values), (raw_ms, raw_values), (scaled_ms, scaled_values)) in enumerate(zip(records, raw, scaled)):
+        if k > 0 and sequence != records[k - 1][0] + 1:
+            failures.append(f"record {k}: sequence {sequence} after {records[k - 1][0]}")
+        # Each download fixes its own epoch offset, they can differ by a millisecond
+        if abs(epoch_us // 1000 - raw_ms) > 1 or abs(epoch_us // 1000 - scaled_ms) > 1:
+            failures.append(f"record {k}: time {epoch_us} us, CSV {raw_ms} and {scaled_ms} ms")
+        if values != raw_values:
+            failures.append(f"record {k}: raw {values}, CSV {raw_values}")
+        if scale(header, values) != scaled_values:
+            failures.append(f"record {k}: scaled {scale(header, values)}, CSV {scaled_values}")
+
+    for failure in failures[:10]:
+        print("FAIL " + failure)
+    print(f"{len(records)} records, version {header['version']}, {len(header['channels'])} values, {len(failures)} failures")
+    sys.exit(1 if failures else 0)
@@ -0,0 +1,71 @@
+/*
+Copyright Production 3000
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Time and heap calls of adding a sample, runtime-sized and fixed-size module, integer and float samples
+
+#define HOSTTEST_COUNT_ALLOCATIONS
+#include "hosttest.h"
+
+
+const uint8_t valueCount = 8;
+
+template <typename T, typename Sensor>
+void run(Sensor& sensor, const char* name, int8_t exponent) {
+    int8_t exponents[valueCount];
+    std::fill(exponents, exponents + valueCount, exponent);
+    sensor.setSampleToIntExponent(exponents);
+    sensor.cfgXmoduleSensor.avgCountSample = 100;
+    sensor.disableMqtt();
+    sensor.disableWebSocket();
+    sensor.setup();
+
+    T sample[valueCount];
+    for (uint8_t i = 0; i < valueCount; i++)
+        sample[i] = (T)(i * 37.25);
+    // Fill the store, measure the steady state
+    for (uint32_t k = 0; k < 100000; k++)
+        sensor.addSample(sample);
+
+    const uint32_t sampleCount = 2000000;
+    uint64_t allocationsBefore = allocationCount;
+    double ns = measure_ns(sampleCount, [&](uint32_t k) {
+        sample[k % valueCount] = (T)(k & 0xFFFF);
+        sensor.addSample(sample);
+    });
+    double allocations = (double)(allocationCount - allocationsBefore) / sampleCount;
+    std::cout << name << ", exponent " << (int)exponent << ": " << ns << " ns per sample of " << (int)valueCount << " values, " << allocations << " heap allocations per sample\n";
+}
+
+struct Sensor : XmoduleSensor {
+    Sensor() : XmoduleSensor(valueCount) { }
+};
+
+// Modules are static like in a sketch, a fresh one per run
+Sensor sensors[4];
+XmoduleSensorN<valueCount, int32_t> sensorsInt[2];
+XmoduleSensorN<valueCount, float_t> sensorsFloat[2];
+
+int main() {
+    run<int32_t>(sensors[0], "runtime int32", 0);
+    run<int32_t>(sensors[1], "runtime int32", 1);
+    run<float_t>(sensors[2], "runtime float", 0);
+    run<float_t>(sensors[3], "runtime float", 2);
+    run<int32_t>(sensorsInt[0], "fixed-size int32", 0);
+    run<int32_t>(sensorsInt[1], "fixed-size int32", 1);
+    run<float_t>(sensorsFloat[0], "fixed-size float", 0);
+    run<float_t>(sensorsFloat[1], "fixed-size float", 2);
+    return 0;
+}
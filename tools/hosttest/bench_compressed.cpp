@@ -0,0 +1,91 @@
+/*
+Copyright Production 3000
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Memory per sample and read time of the history stores, fed with the generators of the noise example at 20 ms
+
+#define HOSTTEST_COUNT_ALLOCATIONS
+#include "hosttest.h"
+
+#include <random>
+
+
+const uint8_t valueCount = 5;
+
+volatile int64_t sink;
+
+// Same patterns as examples/sensor/noise
+struct Noise {
+    std::default_random_engine generator;
+    std::normal_distribution<double_t> distribution { 50.0, 20.0 };
+    int32_t data[valueCount] = { 10, 19, 37, 0, 0 };
+    uint32_t counter = 0;
+    boolean data2 = true;
+
+    Noise() { srand(1234); }
+
+    int32_t* next() {
+        data[0] = -data[0];
+        data[1] += (counter % 20 == 0) ? -38 : 2;
+        if (counter % 75 == 0)
+            data2 = !data2;
+        data[2] += (data2) ? 1 : -1;
+        data[3] += random(15) - 7;
+        data[4] = int32_t(distribution(generator) - 50);
+        counter++;
+        return data;
+    }
+};
+
+template <typename F>
+void run(const char* name, F create, uint32_t sampleCount) {
+    Noise noise;
+    uint64_t bytesBefore = allocationBytes;
+    DataStore* dataStore = create();
+    for (uint32_t k = 0; k < sampleCount; k++)
+        dataStore->append(1000000 + k * 20000ull, noise.next());
+    // Held samples once full, the byte count is what the store requested from the heap, without allocator overhead
+    uint16_t size = dataStore->getSize();
+    double bytes = (double)(allocationBytes - bytesBefore) / size;
+
+    double readNs = measure_ns(200, [&](uint32_t) {
+        int64_t sum = 0;
+        for (uint16_t i = 0; i < size; i++) {
+            int32_t* sample = dataStore->getValues(i);
+            for (uint8_t v = 0; v < valueCount; v++)
+                sum += sample[v];
+            sum += dataStore->getMicrosStamp(i);
+        }
+        sink = sum;
+    }) / size;
+
+    std::cout << name << ": " << size << " samples held, " << bytes << " bytes per sample, sequential read " << readNs << " ns per sample\n";
+    delete dataStore;
+}
+
+int main() {
+    // Compressed store filled past its capacity, the others to the same sample count
+    DataStoreCompressed* compressed = new DataStoreCompressed(valueCount, 256, 8);
+    Noise noise;
+    for (uint32_t k = 0; k < 10000; k++)
+        compressed->append(1000000 + k * 20000ull, noise.next());
+    uint16_t heldCount = compressed->getSize();
+    delete compressed;
+
+    run("compressed, 8 x 256 bytes", [&]() -> DataStore* { return new DataStoreCompressed(valueCount, 256, 8); }, 10000);
+    run("ring buffer", [&]() -> DataStore* { return new DataStoreRingBuffer(valueCount, heldCount); }, heldCount);
+    run("linked list", [&]() -> DataStore* { return new DataStoreLinkedList(valueCount, heldCount); }, heldCount);
+    return 0;
+}
@@ -0,0 +1,76 @@
+/*
+Copyright Production 3000
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Raw and scaled CSV download of a full store through the chunked filler, TCP-sized and small buffers
+
+#define HOSTTEST_COUNT_ALLOCATIONS
+#include "hosttest.h"
+
+#include <unistd.h>
+
+
+const uint8_t valueCount = 4;
+const uint16_t sampleCount = 2000;
+
+struct Sensor : XmoduleSensor {
+    Sensor() : XmoduleSensor(valueCount) { }
+};
+Sensor sensor;
+
+void run(const char* uri, size_t bufferSize) {
+    const uint32_t downloadCount = 50;
+    uint8_t buffer[1460];
+    size_t bytes = 0;
+    uint32_t lineCount = 0;
+    uint64_t allocationsBefore = allocationCount;
+    double ns = measure_ns(downloadCount, [&](uint32_t) {
+        AsyncWebServerRequest request;
+        mvp.net.netWeb.pages[uri](&request);
+        size_t index = 0;
+        lineCount = 0;
+        while (size_t length = request.filler(buffer, bufferSize, index)) {
+            lineCount += std::count(buffer, buffer + length, '\n');
+            index += length;
+        }
+        bytes = index;
+    });
+    std::cout << uri << ", " << bufferSize << " byte buffer: " << ns / lineCount << " ns per line, " << lineCount << " lines, " << bytes << " bytes, " << (double)(allocationCount - allocationsBefore) / downloadCount << " heap allocations per download\n";
+}
+
+int main() {
+    sensor.cfgXmoduleSensor.avgCountSample = 1;
+    sensor.setDataCollectionRingBuffer(sampleCount);
+    sensor.disableMqtt();
+    sensor.disableWebSocket();
+    sensor.setup();
+
+    int32_t sample[valueCount];
+    for (uint16_t k = 0; k < sampleCount; k++) {
+        sample[0] = k;
+        sample[1] = -k * 37;
+        sample[2] = k * 100003;
+        sample[3] = 1 << (k % 31);
+        sensor.addSample(sample);
+        sensor.loop();
+        usleep(100);
+    }
+
+    for (const char* uri : { "/sensordatasraw", "/sensordatasscaled" }) {
+        run(uri, 1460);
+        run(uri, 64);
+    }
+    return 0;
+}
@@ -0,0 +1,61 @@
+/*
+Copyright Production 3000
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Appending, single-value reads, and whole-sample reads of the history stores, row and columnar layout
+
+#include "hosttest.h"
+
+
+volatile int64_t sink;
+
+void run(const char* name, DataStore* dataStore, uint16_t length, uint8_t valueCount) {
+    int32_t values[64] = { 0 };
+    double appendNs = measure_ns(200000, [&](uint32_t k) {
+        values[k % valueCount] = k;
+        dataStore->append(k, values);
+    });
+
+    // Single value of every sample, as the threshold check of a single index or a plot of one value
+    double singleNs = measure_ns(200, [&](uint32_t k) {
+        int64_t sum = 0;
+        for (uint16_t i = 0; i < length; i++)
+            sum += dataStore->getValue(i, k % valueCount);
+        sink = sum;
+    }) / length;
+
+    // All values of every sample, as a download
+    double sampleNs = measure_ns(200, [&](uint32_t k) {
+        int64_t sum = 0;
+        for (uint16_t i = 0; i < length; i++) {
+            int32_t* sample = dataStore->getValues(i);
+            for (uint8_t v = 0; v < valueCount; v++)
+                sum += sample[v];
+        }
+        sink = sum;
+    }) / length;
+
+    std::cout << name << ", " << length << " x " << (int)valueCount << " values: append " << appendNs << " ns, single value " << singleNs << " ns, whole sample " << sampleNs << " ns\n";
+    delete dataStore;
+}
+
+int main() {
+    const uint16_t length = 2000;
+    for (uint8_t valueCount : { 4, 64 }) {
+        run("rows", new DataStoreRingBuffer(valueCount, length), length, valueCount);
+        run("columns", new DataStoreColumnar(valueCount, length), length, valueCount);
+    }
+    return 0;
+}
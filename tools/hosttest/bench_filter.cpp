@@ -0,0 +1,54 @@
+/*
+Copyright Production 3000
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Filter stages on a recorded-like trace: slow sine with noise and spikes, and a steep sawtooth
+
+#include "hosttest.h"
+
+#include <vector>
+
+
+const uint8_t valueCount = 2;
+const uint32_t sampleCount = 200000;
+
+volatile int64_t sink;
+
+int main() {
+    std::vector<int32_t> trace(sampleCount * valueCount);
+    srand(1);
+    for (uint32_t k = 0; k < sampleCount; k++) {
+        trace[k * valueCount] = 1000 + (int32_t)(300 * sin(k * 0.01)) + rand() % 50 - 25 + ((rand() % 500 == 0) ? 5000 : 0);
+        trace[k * valueCount + 1] = -(int32_t)(k % 1000) * 1000;
+    }
+
+    DataFilter* stages[] = { new DataFilterEma(valueCount, 4), new DataFilterMedian(valueCount, 5), new DataFilterCic(valueCount, 10, 3), new DataFilterKalman(valueCount, 4, 625) };
+    for (DataFilter* stage : stages) {
+        int32_t sample[valueCount];
+        int64_t sum = 0;
+        uint32_t outputCount = 0;
+        double ns = measure_ns(sampleCount, [&](uint32_t k) {
+            std::copy(&trace[k * valueCount], &trace[k * valueCount] + valueCount, sample);
+            if (stage->apply(sample)) {
+                sum += sample[0];
+                outputCount++;
+            }
+        });
+        sink = sum;
+        std::cout << stage->getDescription().c_str() << ": " << ns << " ns per sample of " << (int)valueCount << " values, " << outputCount << " of " << sampleCount << " samples passed\n";
+        delete stage;
+    }
+    return 0;
+}
@@ -0,0 +1,42 @@
+/*
+Copyright Production 3000
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Float and fixed-point scaling of a value. The host has a hardware FPU, the ESP8266 emulates float in software and
+// gains considerably more than shown here
+
+#include "hosttest.h"
+
+
+volatile int32_t sink;
+
+int main() {
+    DataProcessing processing;
+    processing.initDataValueSize(4);
+    float_t scalings[4] = { 0.0123f, 1.5f, -37.25f, 2.5e-5f };
+    for (uint8_t i = 0; i < 4; i++) {
+        processing.scaling.values[i] = scalings[i];
+        processing.offset.values[i] = -100 * i;
+    }
+
+    for (boolean fixedPoint : { false, true }) {
+        processing.setFixedPoint(fixedPoint);
+        double ns = measure_ns(20000000, [&](uint32_t k) {
+            sink = processing.applyProcessing((int32_t)(k & 0xFFFFF) - 0x80000, k & 3);
+        });
+        std::cout << (fixedPoint ? "fixed point" : "float") << ": " << ns << " ns per value\n";
+    }
+    return 0;
+}
@@ -0,0 +1,73 @@
+/*
+Copyright Production 3000
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Appending to a full sensor history list, with and without node pool and recycled data structures
+
+#define HOSTTEST_COUNT_ALLOCATIONS
+#include "hosttest.h"
+
+
+typedef DataStoreLinkedList::DataStructSensor DataStruct;
+
+// Each append creates a data structure, the list deletes the oldest node and its data
+struct PlainList : LinkedList3110<DataStruct> {
+    PlainList(uint16_t size) : LinkedList3110<DataStruct>(size) { }
+
+    void append(uint64_t microsStamp, int32_t* values, uint8_t valueCount) {
+        appendDataStruct(new DataStruct(microsStamp, values, valueCount));
+    }
+};
+
+// The list of the data store: nodes from the pool, data structures recycled
+struct PooledList : LinkedList3110<DataStruct> {
+    PooledList(uint16_t size) : LinkedList3110<DataStruct>(size) { enableNodePool(size); }
+
+    void append(uint64_t microsStamp, int32_t* values, uint8_t valueCount) {
+        DataStruct* dataStruct = recycleDataStruct();
+        if (dataStruct == nullptr) {
+            dataStruct = new DataStruct(microsStamp, values, valueCount);
+        } else {
+            dataStruct->update(microsStamp, values);
+        }
+        appendDataStruct(dataStruct);
+    }
+};
+
+template <typename List>
+void run(const char* name, uint16_t listSize, uint8_t valueCount) {
+    const uint32_t appendCount = 2000000;
+    int32_t values[16] = { 0 };
+    List list(listSize);
+    // Fill first, measure the steady state of a full list
+    for (uint16_t k = 0; k < listSize; k++)
+        list.append(k, values, valueCount);
+
+    uint64_t allocationsBefore = allocationCount;
+    double ns = measure_ns(appendCount, [&](uint32_t k) {
+        values[0] = k;
+        list.append(listSize + k, values, valueCount);
+    });
+    double allocations = (double)(allocationCount - allocationsBefore) / appendCount;
+    std::cout << name << ", " << listSize << " x " << (int)valueCount << " values: " << ns << " ns per append, " << allocations << " heap allocations per append\n";
+}
+
+int main() {
+    for (uint8_t valueCount : { 3, 16 }) {
+        run<PlainList>("plain", 100, valueCount);
+        run<PooledList>("pooled", 100, valueCount);
+    }
+    return 0;
+}
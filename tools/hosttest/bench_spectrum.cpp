@@ -0,0 +1,42 @@
+/*
+Copyright Production 3000
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Time to compute the spectrum of a block, the samples are collected outside the measurement
+
+#include "hosttest.h"
+
+#include <random>
+
+
+int main() {
+    std::mt19937 random(1234);
+    std::normal_distribution<double> gauss(0.0, 20.0);
+
+    for (uint16_t n : { 64, 256, 1024 }) {
+        DataSpectrum spectrum(0, n, 8, 0);
+        uint32_t blockCount = 200000 / n;
+        double total_us = 0;
+        for (uint32_t block = 0; block < blockCount; block++) {
+            for (uint16_t k = 0; k < n; k++)
+                spectrum.add(1000 + ((uint64_t)block * n + k) * 1000, lround(1000 * sin(0.37 * k) + gauss(random)));
+            auto start = std::chrono::steady_clock::now();
+            spectrum.compute();
+            total_us += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        }
+        std::cout << "N=" << n << ": " << total_us / blockCount << " us per block\n";
+    }
+    return 0;
+}
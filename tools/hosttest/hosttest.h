@@ -0,0 +1,74 @@
+/*
+Copyright Production 3000
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef HOSTTEST
+#define HOSTTEST
+
+// Shared by all host tests and benchmarks, each is a single program linked with XmoduleSensor.cpp, see run.sh
+
+#include "MVP3000.h"
+#include "XmoduleSensor/XmoduleSensor.h"
+
+#include <chrono>
+#include <iostream>
+#include <new>
+
+EspClass ESP;
+_Helper _helper;
+MVP3000 mvp;
+
+int hosttestFailures = 0;
+
+/** Print and count a failed check, the test exits with the failure count. */
+void check(boolean condition, const String& description) {
+    if (!condition) {
+        std::cout << "FAIL " << description << "\n";
+        hosttestFailures++;
+    }
+}
+
+#ifdef HOSTTEST_COUNT_ALLOCATIONS
+// Heap calls and requested bytes of the whole program, for benchmarks of allocation-free paths and footprints
+uint64_t allocationCount = 0;
+uint64_t allocationBytes = 0;
+
+void* operator new(size_t size) {
+    allocationCount++;
+    allocationBytes += size;
+    void* pointer = malloc(size);
+    if (pointer == nullptr)
+        throw std::bad_alloc();
+    return pointer;
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* pointer) noexcept { free(pointer); }
+void operator delete[](void* pointer) noexcept { free(pointer); }
+void operator delete(void* pointer, size_t) noexcept { free(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { free(pointer); }
+#endif
+
+/** Nanoseconds per call of the function, run count times. */
+template <typename F>
+double measure_ns(uint32_t count, F function) {
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t k = 0; k < count; k++) {
+        function(k);
+    }
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / count;
+}
+
+#endif
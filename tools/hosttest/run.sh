@@ -0,0 +1,58 @@
+#!/bin/sh
+#
+#   Copyright Production 3000
+#
+#   Licensed under the Apache License, Version 2.0 (the "License");
+#   you may not use this file except in compliance with the License.
+#   You may obtain a copy of the License at
+#
+#       http://www.apache.org/licenses/LICENSE-2.0
+#
+#   Unless required by applicable law or agreed to in writing, software
+#   distributed under the License is distributed on an "AS IS" BASIS,
+#   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#   See the License for the specific language governing permissions and
+#   limitations under the License.
+#
+#   Host tests and benchmarks of the sensor module, built against stand-ins of the Arduino core and the framework
+#
+#   Usage: sh run.sh [name ...]
+#       Runs all test_*.cpp with address and undefined behavior sanitizers, then all bench_*.cpp optimized
+#       Names select single tests or benchmarks, for example: sh run.sh test_samplequeue bench_filter
+#       Requires g++ with C++17, python3 for the binary download round trip
+
+set -e
+cd "$(dirname "$0")"
+mkdir -p build
+
+CXX="${CXX:-g++}"
+FLAGS="-std=gnu++17 -DESP8266 -Istub -I../../src"
+SOURCES="../../src/XmoduleSensor/XmoduleSensor.cpp"
+
+names="$*"
+if [ -z "$names" ]; then
+    names="$(ls test_*.cpp bench_*.cpp 2>/dev/null | sed 's/\.cpp$//')"
+fi
+
+failed=""
+for name in $names; do
+    echo "== $name"
+    case "$name" in
+        test_*) $CXX $FLAGS -g -fsanitize=address,undefined -fno-sanitize-recover=undefined "$name.cpp" $SOURCES -o "build/$name" -lpthread ;;
+        *) $CXX $FLAGS -O2 "$name.cpp" $SOURCES -o "build/$name" -lpthread ;;
+    esac
+    (cd build && "./$name") || failed="$failed $name"
+
+    # Data race check of the queue, the sanitizers above cannot be combined with this one
+    if [ "$name" = "test_samplequeue" ]; then
+        echo "== $name (thread sanitizer)"
+        $CXX $FLAGS -g -O1 -fsanitize=thread "$name.cpp" $SOURCES -o "build/${name}_tsan" -lpthread
+        (cd build && "./${name}_tsan") || failed="$failed ${name}_tsan"
+    fi
+done
+
+if [ -n "$failed" ]; then
+    echo "Failed:$failed"
+    exit 1
+fi
+echo "All passed"
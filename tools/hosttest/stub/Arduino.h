@@ -0,0 +1,92 @@
+/*
+Copyright Production 3000
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Host stand-in for the Arduino core, only what the sensor module uses
+#pragma once
+#include <cstdint>
+#include <cstdarg>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <functional>
+#include <limits>
+#include <algorithm>
+#include <sys/time.h>
+#include <time.h>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+typedef bool boolean;
+#define PROGMEM
+#define PGM_P const char*
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define bitSet(value, bit) ((value) |= (1UL << (bit)))
+#define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
+#define IRAM_ATTR
+using std::min; using std::max;
+inline double pow10(double x) { return pow(10.0, x); }
+inline std::chrono::steady_clock::time_point bootTime() { static auto t0 = std::chrono::steady_clock::now(); return t0; }
+inline uint64_t micros64() { using namespace std::chrono; return duration_cast<microseconds>(steady_clock::now()-bootTime()).count(); }
+inline unsigned long millis() { return micros64() / 1000; }
+inline unsigned long micros() { return (uint32_t)micros64(); }
+inline void delay(unsigned long) {}
+inline void yield() {}
+inline long random(long a) { return rand() % a; }
+inline long random(long a, long b) { return a + rand() % (b - a); }
+inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+inline void noInterrupts() {}
+inline void interrupts() {}
+class String : public std::string {
+public:
+  String() {}
+  String(const char* s) : std::string(s ? s : "") {}
+  String(const std::string& s) : std::string(s) {}
+  String(char c) : std::string(1, c) {}
+  String(int v) : std::string(std::to_string(v)) {}
+  String(unsigned v) : std::string(std::to_string(v)) {}
+  String(long v) : std::string(std::to_string(v)) {}
+  String(unsigned long v) : std::string(std::to_string(v)) {}
+  String(long long v) : std::string(std::to_string(v)) {}
+  String(unsigned long long v) : std::string(std::to_string(v)) {}
+  String(float v, unsigned d = 2) { char b[64]; snprintf(b, 64, "%.*f", d, v); assign(b); }
+  String(double v, unsigned d = 2) { char b[64]; snprintf(b, 64, "%.*f", d, v); assign(b); }
+  String& operator+=(const String& s) { append(s); return *this; }
+  String& operator+=(const char* s) { append(s); return *this; }
+  String& operator+=(char c) { push_back(c); return *this; }
+  String& operator+=(int v) { append(std::to_string(v)); return *this; }
+  String& operator+=(long v) { append(std::to_string(v)); return *this; }
+  String& operator+=(unsigned v) { append(std::to_string(v)); return *this; }
+  String& operator+=(unsigned long v) { append(std::to_string(v)); return *this; }
+  String& operator+=(long long v) { append(std::to_string(v)); return *this; }
+  String& operator+=(unsigned long long v) { append(std::to_string(v)); return *this; }
+  unsigned length() const { return size(); }
+  long toInt() const { return atol(c_str()); }
+  float toFloat() const { return atof(c_str()); }
+  bool equals(const String& s) const { return *this == s; }
+  char charAt(unsigned i) const { return at(i); }
+  bool reserve(unsigned n) { std::string::reserve(n); return true; }
+  int indexOf(char c, unsigned from = 0) const { auto p = find(c, from); return p == npos ? -1 : (int)p; }
+  bool startsWith(const char* p) const { return compare(0, strlen(p), p) == 0; }
+  String substring(unsigned a) const { return String(substr(a)); }
+  String substring(unsigned a, unsigned b) const { return String(substr(a, b - a)); }
+  void trim() {}
+};
+inline String operator+(const String& a, const String& b) { String r(a); r.append(b); return r; }
+inline String operator+(const String& a, const char* b) { String r(a); r.append(b); return r; }
+inline String operator+(const char* a, const String& b) { String r(a); r.append(b); return r; }
+struct EspClass { uint32_t getFreeHeap() { return 40000; } uint8_t getHeapFragmentation() { return 10; } };
+extern EspClass ESP;
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
@@ -0,0 +1,50 @@
+/*
+Copyright Production 3000
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Host stand-in for ArduinoJson, a tree of nodes with the calls the sensor module uses
+#pragma once
+#include <map>
+#include <vector>
+#include <memory>
+#include <string>
+struct JNode { int t = 0; double d = 0; String s; std::vector<std::shared_ptr<JNode>> a; std::map<std::string, std::shared_ptr<JNode>> o; };
+struct JsonArray; struct JsonObject;
+struct JsonVariant { std::shared_ptr<JNode> n;
+  template<typename T> bool is() const;
+  template<typename T> T as() const { return (T)n->d; }
+  JsonVariant& operator=(const String& x) { n->t = 3; n->s = x; return *this; }
+  JsonVariant& operator=(double x) { n->t = 1; n->d = x; return *this; }
+  JsonVariant operator[](const char* k) const;
+  bool containsKey(const char* k) const { return n && n->o.count(k); } };
+struct JsonArray { std::shared_ptr<JNode> n;
+  void add(double x) { auto c = std::make_shared<JNode>(); c->t = 1; c->d = x; n->a.push_back(c); }
+  JsonObject createNestedObject();
+  JsonArray createNestedArray() { auto c = std::make_shared<JNode>(); c->t = 4; n->a.push_back(c); return JsonArray{c}; }
+  size_t size() const { return n->a.size(); }
+  JsonVariant operator[](size_t i) const { return JsonVariant{n->a[i]}; } };
+struct JsonObject { std::shared_ptr<JNode> n = std::make_shared<JNode>();
+  JsonArray createNestedArray(const String& k) { auto c = std::make_shared<JNode>(); c->t = 4; n->o[k.c_str()] = c; return JsonArray{c}; }
+  bool containsKey(const String& k) const { return n->o.count(k.c_str()); }
+  JsonVariant operator[](const String& k) { auto& c = n->o[k.c_str()]; if (!c) c = std::make_shared<JNode>(); return JsonVariant{c}; } };
+inline JsonObject JsonArray::createNestedObject() { auto c = std::make_shared<JNode>(); c->t = 5; n->a.push_back(c); JsonObject o; o.n = c; return o; }
+inline JsonVariant JsonVariant::operator[](const char* k) const { auto it = n->o.find(k); if (it == n->o.end()) return JsonVariant{std::make_shared<JNode>()}; return JsonVariant{it->second}; }
+template<typename T> inline bool JsonVariant::is() const { return n && n->t == 1; }
+template<> inline bool JsonVariant::is<JsonArray>() const { return n && n->t == 4; }
+template<> inline bool JsonVariant::is<JsonObject>() const { return n && n->t == 5; }
+template<> inline JsonArray JsonVariant::as<JsonArray>() const { return JsonArray{n}; }
+template<> inline JsonObject JsonVariant::as<JsonObject>() const { JsonObject o; o.n = n; return o; }
+template<> inline String JsonVariant::as<String>() const { return n->t == 3 ? n->s : String(n->d); }
+struct JsonDocument : JsonObject { };
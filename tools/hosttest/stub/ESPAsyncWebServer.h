@@ -0,0 +1,30 @@
+/*
+Copyright Production 3000
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Host stand-in for the web server, a request keeps the parameters and the chunked filler
+#pragma once
+#include <Arduino.h>
+#include <map>
+struct AsyncWebParameter { String n, v; const String& name() const { return n; } const String& value() const { return v; } };
+typedef std::function<size_t(uint8_t*, size_t, size_t)> AwsResponseFiller;
+struct AsyncWebServerRequest {
+  std::map<std::string, String> params; String ctype; AwsResponseFiller filler;
+  bool hasParam(const String& k) { return params.count(k); }
+  AsyncWebParameter p; AsyncWebParameter* getParam(const String& k) { p.n = k; p.v = params[k]; return &p; }
+  void sendChunked(const String& t, AwsResponseFiller f) { ctype = t; filler = f; }
+  void send(int code, const String& t, const String& body) { ctype = t; lastBody = body; }
+  String lastBody;
+};
@@ -0,0 +1,40 @@
+/*
+Copyright Production 3000
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Host stand-in for the framework, logger, WebSocket, and MQTT output are collected, pages are kept by URI
+#pragma once
+#include <Arduino.h>
+#include <cstdarg>
+#include <vector>
+#include <map>
+#include "Config_JsonInterface.h"
+struct CfgLogger { enum Level { INFO, DATA, CONTROL, USER, WARNING, ERROR }; };
+typedef std::function<String(int)> WebArgKeyValue;
+typedef std::function<bool(int, WebArgKeyValue, WebArgKeyValue)> WebActionCallback;
+#include <ESPAsyncWebServer.h>
+typedef std::function<void(AsyncWebServerRequest*)> ArRequestHandlerFunction;
+struct StubLogger { std::vector<std::string> out;
+  void write(CfgLogger::Level, const String& m) { out.push_back(m); }
+  void writeFormatted(CfgLogger::Level, const String& f, ...) { char b[512]; va_list a; va_start(a, f); vsnprintf(b, 512, f.c_str(), a); va_end(a); out.push_back(b); } };
+struct StubConfig { void readCfg(JsonInterface&) {} void writeCfg(JsonInterface&) {} };
+struct StubWs { std::vector<std::string> out; void registerWebSocket(const String&, std::function<void(const String&)> = nullptr) {} void printWebSocket(const String&, const String& m) { out.push_back(m); } };
+struct StubWeb { StubWs webSockets; std::map<std::string, ArRequestHandlerFunction> pages; std::map<std::string, WebActionCallback> actions;
+  void registerAction(const String& k, WebActionCallback c, const String& = "") { actions[k] = c; }
+  void registerCfg(CfgJsonInterface*, std::function<void()> = nullptr) {}
+  void registerFillerPage(const String& u, ArRequestHandlerFunction f) { pages[u] = f; } };
+struct StubMqtt { std::vector<std::string> out; void registerMqtt(const String&, std::function<void(const String&)> = nullptr) {} void printMqtt(const String&, const String& m) { out.push_back(m); } };
+struct StubNet { StubWeb netWeb; StubMqtt netMqtt; };
+struct MVP3000 { StubLogger logger; StubConfig config; StubNet net; void log(const String& m) { logger.write(CfgLogger::USER, m); } };
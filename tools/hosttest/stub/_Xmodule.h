@@ -0,0 +1,24 @@
+/*
+Copyright Production 3000
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Host stand-in for the module base class
+#pragma once
+#include <Arduino.h>
+#include "_Helper_LinkedList.h"
+class _Xmodule { public:
+  _Xmodule(String d, String u) : description(d), uri(u) {}
+  String description; String uri;
+  virtual void setup() {} virtual void loop() {} virtual String webPageProcessor(uint8_t) { return ""; } virtual PGM_P getWebPage() { return ""; } };
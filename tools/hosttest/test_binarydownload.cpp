@@ -0,0 +1,87 @@
+/*
+Copyright Production 3000
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Binary download decoded by tools/binarydecoder/decode.py against the CSV downloads of the same data
+
+#include "hosttest.h"
+
+#include <fstream>
+#include <unistd.h>
+
+
+struct Sensor : XmoduleSensor {
+    Sensor() : XmoduleSensor(4) { }
+    using XmoduleSensor::dataCollection;
+};
+Sensor sensor;
+
+String types[4] = { "Temperature", "Weight", "Pressure", "Humidity" };
+String units[4] = { "C", "g", "hPa", "%" };
+
+// Download through the chunked filler with small and odd buffer sizes, lines are split over calls
+void download(const char* uri, const char* path) {
+    AsyncWebServerRequest request;
+    mvp.net.netWeb.pages[uri](&request);
+    std::ofstream file(path, std::ios::binary);
+    uint8_t buffer[256];
+    size_t index = 0;
+    for (uint32_t call = 0; ; call++) {
+        size_t length = request.filler(buffer, (call % 3 == 0) ? 5 : 200, index);
+        if (length == 0)
+            break;
+        file.write((char*)buffer, length);
+        index += length;
+    }
+}
+
+int main() {
+    sensor.cfgXmoduleSensor.avgCountSample = 1;
+    sensor.setSensorInfo("Round trip", "Binary download", types, units);
+    sensor.disableMqtt();
+    sensor.disableWebSocket();
+
+    // Point table with a first segment longer than 2^16, polynomial, linear with a fraction, linear with an exponent
+    int32_t pointsX[] = { -300000, 4095, 5000, 6000, 7000, 8000 };
+    int32_t pointsY[] = { 2000000, 900, 600, 250, 50, -200 };
+    float_t polynomial[] = { -40.5f, 0.12f, -2.5e-5f, 3e-9f };
+    check(sensor.setCalibrationPoints(0, pointsX, pointsY, 6), "point calibration");
+    check(sensor.setCalibrationPolynomial(1, polynomial, 3, 0, 4095), "polynomial calibration");
+    int8_t exponents[] = { 0, 0, 0, 1 };
+    sensor.setSampleToIntExponent(exponents);
+    sensor.setup();
+
+    DataProcessing& processing = sensor.dataCollection.processing;
+    processing.offset.values[0] = 37;
+    processing.offset.values[1] = -11;
+    processing.offset.values[2] = 1000;
+    processing.scaling.values[2] = 0.37f;
+    processing.scaling.values[3] = 2.5f;
+
+    for (int k = 0; k < 80; k++) {
+        float_t sample[4] = { k * 53.0f - 200, k * 47.0f - 30, k * -12345.0f, k * 0.37f };
+        sensor.addSample(sample);
+        sensor.loop();
+        usleep(1100);
+    }
+    sensor.setTare();
+
+    download("/sensordatasbin", "download.bin");
+    download("/sensordatasraw", "download_raw.csv");
+    download("/sensordatasscaled", "download_scaled.csv");
+
+    check(system("python3 ../../binarydecoder/test_roundtrip.py download.bin download_raw.csv download_scaled.csv") == 0, "decoded binary matches the CSV downloads");
+    return hosttestFailures;
+}
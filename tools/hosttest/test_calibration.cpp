@@ -0,0 +1,104 @@
+/*
+Copyright Production 3000
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Fixed-point calibration against the interpolation in double, random point tables and polynomials with segments from
+// a few to 2^30 inputs long
+
+#include "hosttest.h"
+
+#include <random>
+
+
+std::mt19937 generator(1);
+
+// Largest difference of apply() to applyFloat() over the knots, their neighbours, and random inputs
+double worstDifference(CalibrationTable& table) {
+    double worst = 0;
+    auto compare = [&](int64_t value) {
+        value = constrain(value, (int64_t)std::numeric_limits<int32_t>::min(), (int64_t)std::numeric_limits<int32_t>::max());
+        worst = std::max(worst, fabs(table.apply((int32_t)value) - table.applyFloat((double_t)value)));
+    };
+    for (uint8_t k = 0; k < table.pointCount; k++) {
+        compare((int64_t)table.x[k] - 1);
+        compare(table.x[k]);
+        compare((int64_t)table.x[k] + 1);
+    }
+    for (uint16_t n = 0; n < 2000; n++) {
+        compare(std::uniform_int_distribution<int64_t>(table.x[0], table.x[table.pointCount - 1])(generator));
+    }
+    return worst;
+}
+
+void testPoints() {
+    double worst = 0;
+    for (uint16_t t = 0; t < 500; t++) {
+        // Spacing of the points from single inputs up to 2^30, outputs over the full range
+        uint8_t count = std::uniform_int_distribution<int>(2, CalibrationTable::pointCountMax)(generator);
+        int64_t spacingMax = (int64_t)1 << std::uniform_int_distribution<int>(0, 30)(generator);
+        int32_t x[CalibrationTable::pointCountMax];
+        int32_t y[CalibrationTable::pointCountMax];
+        int64_t position = std::uniform_int_distribution<int64_t>(std::numeric_limits<int32_t>::min(), 0)(generator);
+        uint8_t n = 0;
+        for (; (n < count) && (position <= std::numeric_limits<int32_t>::max()); n++) {
+            x[n] = position;
+            y[n] = (int32_t)generator();
+            position += std::uniform_int_distribution<int64_t>(1, spacingMax)(generator);
+        }
+        if (!CalibrationTable::isValid(x, n))
+            continue;
+        CalibrationTable table(x, y, n);
+        worst = std::max(worst, worstDifference(table));
+    }
+    std::cout << "points: worst difference " << worst << "\n";
+    check(worst < 1, "points within one LSB");
+}
+
+void testPolynomials() {
+    double worst = 0;
+    for (uint16_t t = 0; t < 500; t++) {
+        // Ranges up to 2^26 inputs, segments then reach 2^20
+        int32_t from = std::uniform_int_distribution<int32_t>(-(1 << 25), 1 << 25)(generator);
+        int32_t to = from + std::uniform_int_distribution<int32_t>(1, 1 << 26)(generator);
+        uint8_t degree = std::uniform_int_distribution<int>(1, CalibrationTable::polynomialDegreeMax)(generator);
+        float_t coefficients[CalibrationTable::polynomialDegreeMax + 1];
+        // Scaled so the output stays within about 2^30 over the range
+        double range = std::max(fabs((double)from), fabs((double)to));
+        for (uint8_t d = 0; d <= degree; d++)
+            coefficients[d] = std::uniform_real_distribution<float_t>(-1, 1)(generator) * (1 << 28) / pow(range, d);
+        CalibrationTable table(coefficients, degree, from, to);
+        worst = std::max(worst, worstDifference(table));
+    }
+    std::cout << "polynomials: worst difference " << worst << "\n";
+    check(worst < 1, "polynomials within one LSB");
+}
+
+// Segments beyond 2^30 with a full-range rise, the fraction bits are cut, the error grows to a few LSB
+void testFullRange() {
+    int32_t x[3] = { std::numeric_limits<int32_t>::min(), 0, std::numeric_limits<int32_t>::max() };
+    int32_t y[3] = { std::numeric_limits<int32_t>::max(), std::numeric_limits<int32_t>::min(), std::numeric_limits<int32_t>::max() };
+    CalibrationTable table(x, y, 3);
+    double worst = worstDifference(table);
+    std::cout << "full range: worst difference " << worst << ", " << (int)table.slopeFractionBits << " fraction bits\n";
+    check(worst < 3, "full range within three LSB");
+    check(table.apply(x[1]) == y[1], "knot exact");
+}
+
+int main() {
+    testPoints();
+    testPolynomials();
+    testFullRange();
+    return hosttestFailures;
+}
@@ -0,0 +1,110 @@
+/*
+Copyright Production 3000
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Compressed store against the ring buffer as reference, random appends, removals and clears with extreme deltas, and
+// rejection of invalid block sizes
+
+#include "hosttest.h"
+
+#include <climits>
+#include <random>
+
+
+struct Sensor : XmoduleSensor {
+    Sensor() : XmoduleSensor(4) { }
+    using XmoduleSensor::dataCollection;
+};
+Sensor sensor;
+
+// Blocks too small or too few are rejected and the store is kept
+void testInvalid() {
+    sensor.setup();
+    DataStore* dataStore = sensor.dataCollection.dataStore;
+    check(!sensor.setDataCollectionCompressed(1), "single block rejected");
+    check(!sensor.setDataCollectionCompressed(4, 29), "block smaller than a sample rejected");
+    check(sensor.dataCollection.dataStore == dataStore, "store kept");
+    check(sensor.setDataCollectionCompressed(2, 30), "smallest valid blocks");
+    check(!sensor.addDataTierCompressed(1000, 4, 69), "tier block smaller than a row rejected");
+    check(sensor.addDataTierCompressed(1000, 2, 70), "smallest valid tier blocks");
+}
+
+int main() {
+    testInvalid();
+
+    std::mt19937 random(1);
+    for (uint8_t config = 0; config < 6; config++) {
+        uint8_t valueCount = 1 + config * 7;
+        DataStoreCompressed compressed(valueCount, 16 + config * 40, 2 + config);
+        // Reference holds more, the compressed window is compared to its newest part
+        DataStoreRingBuffer reference(valueCount, 4000);
+
+        int32_t values[64] = { 0 };
+        uint64_t microsStamp = 1000;
+        uint32_t checkCount = 0;
+        for (uint32_t k = 0; k < 20000; k++) {
+            uint32_t operation = random() % 20;
+            if (operation < 14) {
+                // Mostly small steps, sometimes large jumps in time and values
+                microsStamp += (random() % 10 == 0) ? (random() % 100000000ull) * 1000 : random() % 300;
+                for (uint8_t i = 0; i < valueCount; i++) {
+                    if (random() % 50 == 0)
+                        values[i] = (int32_t)random();
+                    else if (random() % 30 == 0)
+                        values[i] = INT32_MIN + (int32_t)(random() % 3);
+                    else
+                        values[i] = (int32_t)((uint32_t)values[i] + (random() % 7) - 3);
+                }
+                compressed.append(microsStamp, values);
+                reference.append(microsStamp, values);
+            } else if (operation < 18) {
+                // Single and repeated removal, the second one is beyond the undo
+                uint8_t removeCount = (random() % 3 == 0) ? 2 : 1;
+                for (uint8_t r = 0; r < removeCount; r++) {
+                    if (compressed.getSize() > 0) {
+                        compressed.removeNewest();
+                        reference.removeNewest();
+                    }
+                }
+            } else if (random() % 50 == 0) {
+                compressed.clear();
+                reference.clear();
+            }
+
+            check(compressed.sequenceNext == reference.sequenceNext, "sequence number");
+            uint16_t size = compressed.getSize();
+            if (size > reference.getSize()) {
+                check(false, "size within the reference");
+                break;
+            }
+            uint16_t referenceOffset = reference.getSize() - size;
+            // Few random reads, sometimes all in order for the sequential decoder
+            boolean sequential = (random() % 10 == 0);
+            uint16_t readCount = sequential ? size : std::min<uint16_t>(size, 3);
+            for (uint16_t r = 0; r < readCount; r++) {
+                uint16_t index = sequential ? r : random() % size;
+                boolean equal = (compressed.getMicrosStamp(index) == reference.getMicrosStamp(index + referenceOffset))
+                    && (memcmp(compressed.getValues(index), reference.getValues(index + referenceOffset), sizeof(int32_t) * valueCount) == 0);
+                if (!equal) {
+                    check(false, "sample " + String(index) + " of configuration " + String(config) + " at step " + String(k));
+                    return hosttestFailures;
+                }
+                checkCount++;
+            }
+        }
+        std::cout << "configuration " << (int)config << ": " << checkCount << " samples compared, " << compressed.getSize() << " held\n";
+    }
+    return hosttestFailures;
+}
@@ -0,0 +1,127 @@
+/*
+Copyright Production 3000
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Event capture, rejection of rings beyond 16 bits or the free heap, WebSocket frame against the chunked download, and
+// the early end of a download when the next event is kept
+
+#include "hosttest.h"
+
+#include <algorithm>
+
+
+struct Sensor : XmoduleSensor {
+    Sensor() : XmoduleSensor(4) { }
+    using XmoduleSensor::dataCollection;
+};
+Sensor sensor;
+Sensor sensorEvent;
+
+// The stand-in reports 40000 bytes of free heap, 16384 are kept, a sample of 4 values takes 24 bytes in each ring
+void testInvalid() {
+    sensor.setup();
+    check(!sensor.addEventTrigger(0, EventCapture::TriggerMode::RISING, 10), "trigger without capture rejected");
+    check(!sensor.enableEventCapture(0, 65535), "ring of 65536 samples rejected");
+    check(!sensor.enableEventCapture(65535, 65535), "wrapping ring rejected");
+    check(sensor.dataCollection.eventCapture == nullptr, "capture not enabled");
+    check(sensor.enableEventCapture(100, 100), "small ring");
+    EventCapture* eventCapture = sensor.dataCollection.eventCapture;
+    check(!sensor.enableEventCapture(1000, 1000), "ring beyond the free heap rejected");
+    check(sensor.dataCollection.eventCapture == eventCapture, "capture kept");
+    check(sensor.enableEventCapture(0, 0), "single sample");
+    check(!sensor.enableEventCapture(250, 250), "ring beyond the free heap rejected");
+    check(sensor.enableEventCapture(245, 246), "largest ring");
+    // Fits only because the previous ring is freed first
+    check(sensor.enableEventCapture(245, 246), "largest ring replaced");
+    check(sensor.dataCollection.eventCapture->capacity == 492, "ring capacity");
+    check(sensor.addEventTrigger(0, EventCapture::TriggerMode::RISING, 10), "trigger added");
+}
+
+// Samples with a step of the first value at the given count, the event is kept in the loop
+void addSamples(uint32_t count, uint32_t stepAt) {
+    static uint32_t k = 0;
+    for (uint32_t end = k + count; k < end; k++) {
+        float_t sample[4] = { (k % 100 == stepAt) ? 500.0f : 10.0f, k * 3.0f, -1.0f * k, 7.0f };
+        sensorEvent.addSample(sample);
+        sensorEvent.loop();
+    }
+}
+
+// Read through the chunked filler with small and odd buffer sizes, optionally stop after some calls
+String download(AsyncWebServerRequest& request, uint32_t callMax = UINT32_MAX) {
+    String content;
+    uint8_t buffer[256];
+    size_t index = 0;
+    for (uint32_t call = 0; call < callMax; call++) {
+        size_t length = request.filler(buffer, (call % 3 == 0) ? 5 : 200, index);
+        if (length == 0)
+            break;
+        content += std::string((char*)buffer, length);
+        index += length;
+    }
+    return content;
+}
+
+void testDownload() {
+    sensorEvent.cfgXmoduleSensor.avgCountSample = 1;
+    sensorEvent.disableMqtt();
+    sensorEvent.enableEventCapture(20, 30);
+    sensorEvent.addEventTrigger(0, EventCapture::TriggerMode::RISING, 100);
+    sensorEvent.setup();
+    sensorEvent.dataCollection.processing.offset.values[1] = 5;
+    sensorEvent.dataCollection.processing.scaling.values[1] = 0.5f;
+
+    AsyncWebServerRequest empty;
+    mvp.net.netWeb.pages["/sensorevent"](&empty);
+    check(empty.lastBody == "No event captured.", "no event yet");
+
+    // Trigger sample at 40, the ring holds 20 before and 30 after
+    addSamples(100, 40);
+    // Data lines go to the same output of the stand-in
+    std::vector<std::string> frames;
+    auto collectFrames = [&]() {
+        for (std::string& out : mvp.net.netWeb.webSockets.out) {
+            if (out.rfind("event,", 0) == 0)
+                frames.push_back(out);
+        }
+        mvp.net.netWeb.webSockets.out.clear();
+    };
+    collectFrames();
+    check(frames.size() == 1, "one event sent");
+    String frame = (frames.size() > 0) ? String(frames.back()) : String();
+    check(frame.find(",0,51\n") != std::string::npos, "event header");
+    check(std::count(frame.begin(), frame.end(), '\n') == 52, "header and 51 samples");
+    check(frame.find("\n0,500,62,-40,7;\n") != std::string::npos, "trigger sample processed at time 0");
+
+    AsyncWebServerRequest request;
+    mvp.net.netWeb.pages["/sensorevent"](&request);
+    check(download(request) == frame, "download equals frame");
+
+    // The next event replaces the kept one during a download, the download ends early with a prefix
+    AsyncWebServerRequest interrupted;
+    mvp.net.netWeb.pages["/sensorevent"](&interrupted);
+    String prefix = download(interrupted, 4);
+    addSamples(100, 40);
+    collectFrames();
+    check(frames.size() == 2, "second event sent");
+    prefix += download(interrupted);
+    check((prefix.length() < frame.length()) && (frame.rfind(prefix, 0) == 0), "interrupted download is a prefix");
+}
+
+int main() {
+    testInvalid();
+    testDownload();
+    return hosttestFailures;
+}
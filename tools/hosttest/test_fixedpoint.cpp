@@ -0,0 +1,80 @@
+/*
+Copyright Production 3000
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Fixed-point scaling against the float pipeline and an exact reference, over random scalings of ten decades
+
+#include "hosttest.h"
+
+#include <random>
+
+
+int main() {
+    std::mt19937 random(1);
+    DataProcessing processing;
+    processing.initDataValueSize(1);
+
+    int32_t worstToExact = 0;
+    int32_t worstToFloat = 0;
+    uint32_t fallbackCount = 0;
+    for (uint16_t t = 0; t < 2000; t++) {
+        float_t scaling = std::uniform_real_distribution<float_t>(-4, 4)(random) * powf(10, std::uniform_int_distribution<int>(-6, 3)(random));
+        processing.scaling.values[0] = scaling;
+        processing.offset.values[0] = std::uniform_int_distribution<int32_t>(-1000, 1000)(random);
+        processing.tare.values[0] = std::uniform_int_distribution<int32_t>(-100, 100)(random);
+        processing.setFixedPoint(true);
+        // Only factors beyond the 64-bit product range keep float
+        boolean representable = (fabsf(scaling) >= ldexpf(1, -33)) && (fabsf(scaling) < ldexpf(1, 30));
+        if (processing.scalingFixedShift.values[0] < 0) {
+            fallbackCount++;
+            check(!representable, "float fallback of a representable scaling");
+        }
+
+        for (uint16_t k = 0; k < 200; k++) {
+            int32_t value = std::uniform_int_distribution<int32_t>(-(1 << 16), 1 << 16)(random);
+            double exact = ((double)value + processing.offset.values[0]) * (double)scaling + processing.tare.values[0];
+            if (fabs(exact) > 2e9)
+                continue;
+            processing.fixedPoint = true;
+            int32_t fixed = processing.applyProcessing(value, 0);
+            processing.fixedPoint = false;
+            int32_t floating = processing.applyProcessing(value, 0);
+
+            worstToExact = std::max(worstToExact, (int32_t)labs((long)fixed - lround(exact)));
+            // Float itself is exact only up to 24 bit
+            if (fabs(exact) < (1 << 23))
+                worstToFloat = std::max(worstToFloat, (int32_t)labs((long)fixed - floating));
+        }
+    }
+    std::cout << "worst difference to exact " << worstToExact << ", to float " << worstToFloat << ", float fallbacks " << fallbackCount << "\n";
+    check(worstToExact <= 1, "within one LSB of the exact result");
+    check(worstToFloat <= 1, "within one LSB of the float pipeline");
+
+    // Zero and out-of-range scalings
+    processing.offset.values[0] = 10;
+    processing.tare.values[0] = 5;
+    processing.scaling.values[0] = 0;
+    processing.setFixedPoint(true);
+    check(processing.applyProcessing(1234, 0) == 5, "zero scaling");
+    processing.scaling.values[0] = 1e12f;
+    processing.setFixedPoint(true);
+    check(processing.scalingFixedShift.values[0] == -1, "huge scaling falls back to float");
+    processing.scaling.values[0] = 1e-20f;
+    processing.setFixedPoint(true);
+    check(processing.scalingFixedShift.values[0] == -1, "tiny scaling falls back to float");
+    check(processing.applyProcessing(1234, 0) == 5, "tiny scaling");
+
+    return hosttestFailures;
+}
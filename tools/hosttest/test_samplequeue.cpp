@@ -0,0 +1,159 @@
+/*
+Copyright Production 3000
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Producer and consumer of the sample queue in two threads, run.sh also builds it with ThreadSanitizer
+
+#include "hosttest.h"
+
+#include <atomic>
+#include <thread>
+#include <unistd.h>
+
+
+struct Sensor : XmoduleSensor {
+    Sensor() : XmoduleSensor(3) { }
+    using XmoduleSensor::dataCollection;
+};
+Sensor sensor;
+Sensor sensorLate;
+
+
+// Every accepted sample arrives once, in order, and intact, a small ring runs full and empty all the time
+void testQueue() {
+    SampleQueue queue(3, 100);
+    const uint32_t sampleCount = 500000;
+    std::atomic<boolean> done(false);
+    uint32_t accepted = 0;
+    uint32_t attempts = 0;
+
+    std::thread producer([&] {
+        int32_t sample[3];
+        for (uint32_t k = 0; k < sampleCount; k++) {
+            sample[0] = k;
+            sample[1] = ~k;
+            sample[2] = k * 7;
+            // Most samples are retried until accepted, every eighth is tried once and may be dropped
+            boolean pushed;
+            while (true) {
+                pushed = queue.push(sample, k);
+                attempts++;
+                if (pushed || (k % 8 == 0))
+                    break;
+                std::this_thread::yield();
+            }
+            if (pushed)
+                accepted++;
+        }
+        done = true;
+    });
+
+    uint32_t received = 0;
+    int64_t last = -1;
+    boolean intact = true;
+    while (true) {
+        uint32_t stamp_us;
+        int32_t* sample = queue.peek(stamp_us);
+        if (sample == nullptr) {
+            if (done && (queue.getSize() == 0))
+                break;
+            continue;
+        }
+        uint32_t k = sample[0];
+        if (((int64_t)k <= last) || (sample[1] != (int32_t)~k) || (sample[2] != (int32_t)(k * 7)) || (stamp_us != k))
+            intact = false;
+        last = k;
+        received++;
+        queue.release();
+    }
+    producer.join();
+
+    std::cout << "queue capacity " << queue.capacity << ", accepted " << accepted << ", dropped " << queue.overflowCount << "\n";
+    check(intact, "samples in order and intact");
+    check(received == accepted, "every accepted sample received once");
+    check(accepted + queue.overflowCount == attempts, "every attempt accepted or counted as dropped");
+    check(accepted >= sampleCount / 8 * 7, "retried samples all accepted");
+}
+
+// A producer at about 20 kHz against a loop stalling for 20 ms, the queue covers the stall
+void testModule() {
+    const int sampleCount = 20000;
+    sensor.cfgXmoduleSensor.avgCountSample = 10;
+    sensor.setDataCollectionRingBuffer(sampleCount / 10);
+    sensor.enableSampleQueue(4096);
+    sensor.disableMqtt();
+    sensor.disableWebSocket();
+    sensor.setup();
+
+    std::atomic<boolean> done(false);
+    std::thread producer([&] {
+        int32_t sample[3];
+        for (int k = 0; k < sampleCount; k++) {
+            sample[0] = k;
+            sample[1] = 1;
+            sample[2] = -k;
+            sensor.queueSample(sample);
+            usleep(50);
+        }
+        done = true;
+    });
+    for (int loops = 1; !done; loops++) {
+        sensor.loop();
+        usleep((loops % 500 == 0) ? 20000 : 10);
+    }
+    producer.join();
+    sensor.loop();
+
+    DataStore* dataStore = sensor.dataCollection.dataStore;
+    uint16_t gaps = 0;
+    boolean increasing = true;
+    for (uint16_t i = 1; i < dataStore->getSize(); i++) {
+        if (dataStore->getValues(i)[0] - dataStore->getValues(i - 1)[0] != 10)
+            gaps++;
+        if (dataStore->getMicrosStamp(i) < dataStore->getMicrosStamp(i - 1))
+            increasing = false;
+    }
+    std::cout << "module stored " << dataStore->getSize() << ", dropped " << sensor.dataCollection.sampleQueue->overflowCount << "\n";
+    check(sensor.dataCollection.sampleQueue->overflowCount == 0, "no sample dropped during the stalls");
+    check(dataStore->getSize() == sampleCount / 10, "all averages stored");
+    check(gaps == 0, "averages without gaps");
+    check(increasing, "time stamps increasing");
+}
+
+// A sample queued after the loop read the clock is stamped now, not 71 minutes before, and no queue rejects samples
+void testLateSample() {
+    int32_t sample[3] = { 1, 2, 3 };
+    check(!sensorLate.queueSample(sample), "sample rejected without queue");
+
+    sensorLate.cfgXmoduleSensor.avgCountSample = 1;
+    sensorLate.enableSampleQueue(16);
+    sensorLate.disableMqtt();
+    sensorLate.disableWebSocket();
+    sensorLate.setup();
+    usleep(1000);
+
+    uint64_t nowMicros = DataCollection::getMicros64();
+    check(sensorLate.queueSample(sample, (uint32_t)nowMicros + 50), "late sample queued");
+    check(sensorLate.dataCollection.drainSample(nowMicros), "late sample drained");
+    DataStore* dataStore = sensorLate.dataCollection.dataStore;
+    check((dataStore->getSize() == 1) && (dataStore->getMicrosStamp(0) == nowMicros), "late sample stamped now");
+}
+
+int main() {
+    testQueue();
+    testModule();
+    testLateSample();
+    return hosttestFailures;
+}
@@ -0,0 +1,144 @@
+/*
+Copyright Production 3000
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Fixed-point spectrum against a double-precision DFT with an exact Hann window
+
+#include "hosttest.h"
+
+#include <vector>
+
+
+struct Reference {
+    std::vector<double> bandRms;
+    double peakFrequency;
+    double peakAmplitude;
+};
+
+// Same definitions as DataSpectrum: mean removed, Hann window, one-sided RMS per band, log-parabola peak
+Reference dft(const std::vector<int32_t>& x, uint8_t bandCount, double sampleRate) {
+    int n = x.size();
+    int half = n / 2;
+    double mean = 0;
+    for (int32_t value : x)
+        mean += value;
+    mean /= n;
+
+    std::vector<double> window(n);
+    double windowSum = 0;
+    double windowSquareSum = 0;
+    for (int k = 0; k < n; k++) {
+        window[k] = 0.5 - 0.5 * cos(2 * M_PI * k / n);
+        windowSum += window[k];
+        windowSquareSum += window[k] * window[k];
+    }
+
+    std::vector<double> power(half + 1);
+    for (int f = 0; f <= half; f++) {
+        double re = 0;
+        double im = 0;
+        for (int k = 0; k < n; k++) {
+            re += (x[k] - mean) * window[k] * cos(2 * M_PI * f * k / n);
+            im -= (x[k] - mean) * window[k] * sin(2 * M_PI * f * k / n);
+        }
+        power[f] = re * re + im * im;
+    }
+
+    Reference reference;
+    reference.bandRms.assign(bandCount, 0);
+    int peak = 1;
+    for (int f = 1; f <= half; f++) {
+        int band = std::min(f * bandCount / half, bandCount - 1);
+        reference.bandRms[band] += ((f < half) ? 2 : 1) * power[f] / (n * windowSquareSum);
+        if (power[f] > power[peak])
+            peak = f;
+    }
+    for (double& rms : reference.bandRms)
+        rms = sqrt(rms);
+
+    double offset = 0;
+    if (peak < half) {
+        double left = log(power[peak - 1] + 1e-30);
+        double center = log(power[peak]);
+        double right = log(power[peak + 1] + 1e-30);
+        if (left - 2 * center + right < 0)
+            offset = std::max(-0.5, std::min(0.5, 0.5 * (left - right) / (left - 2 * center + right)));
+    }
+    reference.peakFrequency = (peak + offset) * sampleRate / n;
+    reference.peakAmplitude = sqrt(power[peak]) * 2 / windowSum / ((peak == half) ? 2 : 1);
+    return reference;
+}
+
+// Spectrum of one block sampled at 1 kHz, band errors are relative to the total RMS
+void compare(const std::vector<int32_t>& x, uint8_t bandCount, const String& name, boolean checkPeak) {
+    uint16_t n = x.size();
+    DataSpectrum spectrum(0, n, bandCount, 0);
+    for (uint16_t k = 0; k < n; k++)
+        spectrum.add(1000 + (uint64_t)k * 1000, x[k]);
+    check(spectrum.isReady(), name + " block complete");
+    spectrum.compute();
+
+    Reference reference = dft(x, bandCount, spectrum.sampleRate);
+    double total = 0;
+    for (double rms : reference.bandRms)
+        total += rms * rms;
+    total = sqrt(total);
+    double worst = 0;
+    for (uint8_t b = 0; b < bandCount; b++)
+        worst = std::max(worst, fabs(spectrum.bandRms[b] - reference.bandRms[b]) / total);
+
+    std::cout << name << ": band error " << worst << " of total RMS, peak " << spectrum.peakFrequency << " Hz (" << reference.peakFrequency << "), amplitude " << spectrum.peakAmplitude << " (" << reference.peakAmplitude << ")\n";
+    check(worst < 1e-3, name + " bands");
+    if (checkPeak) {
+        check(fabs(spectrum.peakFrequency - reference.peakFrequency) < 0.01 * spectrum.sampleRate / n, name + " peak frequency");
+        check(fabs(spectrum.peakAmplitude / reference.peakAmplitude - 1) < 1e-2, name + " peak amplitude");
+    }
+}
+
+int main() {
+    for (uint16_t n : { 16, 64, 256, 1024 }) {
+        uint8_t bandCount = std::min(8, n / 2);
+        std::vector<int32_t> x(n);
+
+        // Off-bin sines from small to large amplitudes, with an offset
+        for (double amplitude : { 3.0, 1000.0, 1e8 }) {
+            for (uint16_t k = 0; k < n; k++)
+                x[k] = lround(amplitude * sin(2 * M_PI * 0.23 * k) + 12345);
+            compare(x, bandCount, "N=" + String(n) + " sine " + String(amplitude, 0), amplitude > 100);
+        }
+
+        // Impulses, a flat spectrum, at the window center and off center
+        for (uint16_t position : { (uint16_t)(n / 2), (uint16_t)(n / 3) }) {
+            std::fill(x.begin(), x.end(), -50);
+            x[position] = 100000;
+            compare(x, bandCount, "N=" + String(n) + " impulse at " + String(position), false);
+        }
+    }
+
+    // Full-range alternating input must not overflow
+    std::vector<int32_t> extreme(64);
+    for (uint16_t k = 0; k < extreme.size(); k++)
+        extreme[k] = (k % 2) ? std::numeric_limits<int32_t>::max() : std::numeric_limits<int32_t>::min();
+    compare(extreme, 4, "full range", true);
+
+    // A constant has no spectrum
+    DataSpectrum constant(0, 64, 4, 0);
+    for (uint16_t k = 0; k < 64; k++)
+        constant.add(1000 + k * 1000, 77);
+    constant.compute();
+    check((constant.bandRms[0] == 0) && (constant.mean == 77), "constant");
+
+    return hosttestFailures;
+}
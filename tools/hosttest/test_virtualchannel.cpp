@@ -0,0 +1,111 @@
+/*
+Copyright Production 3000
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Virtual channels, compiled expressions against expected results, damaged and random code never leaves the stack
+
+#include "hosttest.h"
+
+#include <random>
+
+
+struct Sensor : XmoduleSensor {
+    Sensor() : XmoduleSensor(2, 1) { }
+    using XmoduleSensor::dataCollection;
+};
+Sensor sensor;
+
+void testCompiled() {
+    int32_t values[2] = { 3, -4 };
+    float_t stack[VirtualChannel::stackDepthMax];
+    VirtualChannel channel;
+    check(channel.compile("v1 + v2 * 2", 2) && (channel.evaluate(values, stack) == -5), "sum and product");
+    check(channel.compile("max(v1, -v2) ^ 2 - abs(v2)", 2) && (channel.evaluate(values, stack) == 12), "functions and power");
+    check(channel.compile("", 2) && (channel.evaluate(values, stack) == 0), "empty expression");
+    check(!channel.compile("v3", 2), "value beyond the limit rejected");
+    check(!channel.compile("1+(2+(3+(4+(5+(6+(7+(8+9)))))))", 2), "stack too deep rejected");
+}
+
+// Damaged code as from a torn copy gives NaN
+void testDamaged() {
+    int32_t values[2] = { 3, -4 };
+    float_t stack[VirtualChannel::stackDepthMax];
+    VirtualChannel channel;
+    auto evaluate = [&](std::initializer_list<uint8_t> code, uint8_t constantCount) {
+        channel.codeLength = 0;
+        for (uint8_t op : code)
+            channel.code[channel.codeLength++] = op;
+        channel.constantCount = constantCount;
+        channel.valueLimit = 2;
+        return channel.evaluate(values, stack);
+    };
+    check(std::isnan(evaluate({ VirtualChannel::OpCode::ADD }, 0)), "operation on empty stack");
+    check(std::isnan(evaluate({ VirtualChannel::OpCode::VALUE, 0, VirtualChannel::OpCode::NEGATE, VirtualChannel::OpCode::SUBTRACT }, 0)), "operation on single entry");
+    check(std::isnan(evaluate({ VirtualChannel::OpCode::CONSTANT, 5 }, 1)), "constant beyond the count");
+    check(std::isnan(evaluate({ VirtualChannel::OpCode::VALUE, 2 }, 0)), "value beyond the limit");
+    check(std::isnan(evaluate({ VirtualChannel::OpCode::VALUE }, 0)), "missing index");
+    check(std::isnan(evaluate({ 200 }, 0)), "unknown operation");
+    check(std::isnan(evaluate({ VirtualChannel::OpCode::VALUE, 0, VirtualChannel::OpCode::VALUE, 1 }, 0)), "two entries left");
+    std::initializer_list<uint8_t> deep = { 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0 };
+    check(std::isnan(evaluate(deep, 0)), "stack overflow");
+    check(evaluate({ VirtualChannel::OpCode::VALUE, 1, VirtualChannel::OpCode::ABS }, 0) == 4, "valid code");
+}
+
+// Random code with small indices, the stack is exactly stackDepthMax on the heap for the address sanitizer
+void testRandom() {
+    std::mt19937 random(1);
+    int32_t values[2] = { 3, -4 };
+    float_t* stack = new float_t[VirtualChannel::stackDepthMax];
+    VirtualChannel channel;
+    uint32_t validCount = 0;
+    for (uint32_t k = 0; k < 200000; k++) {
+        channel.codeLength = 1 + random() % VirtualChannel::codeLengthMax;
+        for (uint8_t pc = 0; pc < channel.codeLength; pc++)
+            channel.code[pc] = (random() % 4 == 0) ? random() % 3 : random() % 16;
+        channel.constantCount = random() % 3;
+        channel.valueLimit = random() % 3;
+        for (uint8_t c = 0; c < channel.constantCount; c++)
+            channel.constants[c] = c + 0.5f;
+        if (!std::isnan(channel.evaluate(values, stack)))
+            validCount++;
+    }
+    delete[] stack;
+    check(validCount > 0, "some random code is valid");
+}
+
+// Set while samples are added, the channel follows the new expression
+void testSensor() {
+    sensor.cfgXmoduleSensor.avgCountSample = 1;
+    sensor.disableMqtt();
+    sensor.disableWebSocket();
+    sensor.setup();
+    DataCollection& dataCollection = sensor.dataCollection;
+    int32_t sample[2] = { 30, 12 };
+    check(dataCollection.setVirtualChannel(0, "v1 - v2"), "expression set");
+    sensor.addSample(sample);
+    check(dataCollection.dataStore->getValues(dataCollection.dataStore->getSize() - 1)[2] == 18, "difference");
+    check(!dataCollection.setVirtualChannel(0, "v3"), "self reference rejected");
+    check(dataCollection.setVirtualChannel(0, "v1 * v2 / 10"), "expression replaced");
+    sensor.addSample(sample);
+    check(dataCollection.dataStore->getValues(dataCollection.dataStore->getSize() - 1)[2] == 36, "new expression");
+}
+
+int main() {
+    testCompiled();
+    testDamaged();
+    testRandom();
+    testSensor();
+    return hosttestFailures;
+}